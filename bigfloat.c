@@ -0,0 +1,213 @@
+///
+//  bigfloat.c
+//  Small fixed-point arbitrary-precision numbers for the deep zoom
+//  reference orbit.
+///
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "bigfloat.h"
+
+// Extra fraction bits kept beyond the pixel size
+#define BF_GUARD_BITS 64
+
+// Longest decimal string bf_from_string accepts
+#define BF_MAX_DIGITS 1024
+
+int bf_limbs_for(double pixel_size) {
+    int bits = BF_GUARD_BITS;
+    if (pixel_size > 0 && pixel_size < 1) {
+        bits += (int)ceil(-log2(pixel_size));
+    }
+
+    int n = 1 + (bits + 31) / 32;
+    return n > BF_MAX_LIMBS ? BF_MAX_LIMBS : n;
+}
+
+static int mag_is_zero(const uint32_t *a, int n) {
+    for (int k = 0; k < n; k++) {
+        if (a[k]) return 0;
+    }
+    return 1;
+}
+
+static int mag_cmp(const uint32_t *a, const uint32_t *b, int n) {
+    for (int k = 0; k < n; k++) {
+        if (a[k] != b[k]) return a[k] < b[k] ? -1 : 1;
+    }
+    return 0;
+}
+
+static void mag_add(uint32_t *r, const uint32_t *a, const uint32_t *b, int n) {
+    uint64_t carry = 0;
+    for (int k = n - 1; k >= 0; k--) {
+        uint64_t sum = (uint64_t)a[k] + b[k] + carry;
+        r[k] = (uint32_t)sum;
+        carry = sum >> 32;
+    }
+}
+
+// r = a - b where a >= b
+static void mag_sub(uint32_t *r, const uint32_t *a, const uint32_t *b, int n) {
+    int64_t borrow = 0;
+    for (int k = n - 1; k >= 0; k--) {
+        int64_t diff = (int64_t)a[k] - b[k] - borrow;
+        borrow = diff < 0;
+        r[k] = (uint32_t)(diff + (borrow ? ((int64_t)1 << 32) : 0));
+    }
+}
+
+void bf_set_precision(bigfloat *a, int n) {
+    for (int k = a->n; k < n; k++) {
+        a->limb[k] = 0;
+    }
+    a->n = n;
+    if (mag_is_zero(a->limb, n)) {
+        a->neg = 0;
+    }
+}
+
+void bf_from_double(bigfloat *r, double d, int n) {
+    memset(r, 0, sizeof(*r));
+    r->n = n;
+    r->neg = d < 0;
+    d = fabs(d);
+
+    for (int k = 0; k < n && d > 0; k++) {
+        double whole = floor(d);
+        r->limb[k] = (uint32_t)whole;
+        d = ldexp(d - whole, 32);
+    }
+    if (mag_is_zero(r->limb, n)) {
+        r->neg = 0;
+    }
+}
+
+double bf_to_double(const bigfloat *a) {
+    double d = 0;
+    for (int k = a->n - 1; k >= 1; k--) {
+        d = ldexp(d + a->limb[k], -32);
+    }
+    d += a->limb[0];
+    return a->neg ? -d : d;
+}
+
+int bf_from_string(bigfloat *r, const char *str, int n) {
+    char digits[BF_MAX_DIGITS];
+    int ndigits = 0;
+    int point = -1;
+    int neg = 0;
+    const char *p = str;
+
+    memset(r, 0, sizeof(*r));
+    r->n = n;
+
+    while (isspace((unsigned char)*p)) p++;
+    if (*p == '-' || *p == '+') {
+        neg = *p == '-';
+        p++;
+    }
+
+    for (; isdigit((unsigned char)*p) || *p == '.'; p++) {
+        if (*p == '.') {
+            if (point >= 0) return -1;
+            point = ndigits;
+        } else {
+            if (ndigits == BF_MAX_DIGITS) return -1;
+            digits[ndigits++] = *p - '0';
+        }
+    }
+    if (ndigits == 0) return -1;
+    if (point < 0) point = ndigits;
+
+    if (*p == 'e' || *p == 'E') {
+        char *end;
+        long exponent = strtol(p + 1, &end, 10);
+        if (end == p + 1 || exponent > BF_MAX_DIGITS || exponent < -BF_MAX_DIGITS) return -1;
+        point += (int)exponent;
+        p = end;
+    }
+    while (isspace((unsigned char)*p)) p++;
+    if (*p != '\0') return -1;
+
+    // Integer part: digits left of the decimal point
+    uint64_t whole = 0;
+    for (int k = 0; k < point; k++) {
+        whole = whole * 10 + (k < ndigits ? digits[k] : 0);
+        if (whole > UINT32_MAX) return -1;
+    }
+
+    // Fraction: fold in the digits from the right, one division by ten each
+    for (int k = ndigits - 1; k >= (point > 0 ? point : 0); k--) {
+        r->limb[0] = digits[k];
+        uint64_t rem = 0;
+        for (int l = 0; l < n; l++) {
+            uint64_t cur = (rem << 32) | r->limb[l];
+            r->limb[l] = (uint32_t)(cur / 10);
+            rem = cur % 10;
+        }
+    }
+    // Leading zeros of the fraction when the point sits left of every digit
+    for (int k = point; k < 0; k++) {
+        uint64_t rem = 0;
+        for (int l = 0; l < n; l++) {
+            uint64_t cur = (rem << 32) | r->limb[l];
+            r->limb[l] = (uint32_t)(cur / 10);
+            rem = cur % 10;
+        }
+    }
+
+    r->limb[0] = (uint32_t)whole;
+    r->neg = neg && !mag_is_zero(r->limb, n);
+    return 0;
+}
+
+void bf_add(bigfloat *r, const bigfloat *a, const bigfloat *b) {
+    int n = a->n;
+
+    if (a->neg == b->neg) {
+        r->neg = a->neg;
+        mag_add(r->limb, a->limb, b->limb, n);
+    } else if (mag_cmp(a->limb, b->limb, n) >= 0) {
+        r->neg = a->neg;
+        mag_sub(r->limb, a->limb, b->limb, n);
+    } else {
+        r->neg = b->neg;
+        mag_sub(r->limb, b->limb, a->limb, n);
+    }
+
+    r->n = n;
+    if (mag_is_zero(r->limb, n)) {
+        r->neg = 0;
+    }
+}
+
+void bf_sub(bigfloat *r, const bigfloat *a, const bigfloat *b) {
+    bigfloat nb = *b;
+    nb.neg = !nb.neg && !mag_is_zero(nb.limb, nb.n);
+    bf_add(r, a, &nb);
+}
+
+void bf_mul(bigfloat *r, const bigfloat *a, const bigfloat *b) {
+    int n = a->n;
+    // p[k + 1] holds the limb of weight 2^(-32k); p[0] only catches overflow
+    uint32_t p[2 * BF_MAX_LIMBS + 1] = {0};
+
+    for (int i = n - 1; i >= 0; i--) {
+        uint64_t carry = 0;
+        for (int j = n - 1; j >= 0; j--) {
+            uint64_t cur = (uint64_t)a->limb[i] * b->limb[j] + p[i + j + 1] + carry;
+            p[i + j + 1] = (uint32_t)cur;
+            carry = cur >> 32;
+        }
+        p[i] = (uint32_t)carry;
+    }
+
+    r->neg = a->neg != b->neg;
+    r->n = n;
+    memcpy(r->limb, p + 1, n * sizeof(uint32_t));
+    if (mag_is_zero(r->limb, n)) {
+        r->neg = 0;
+    }
+}
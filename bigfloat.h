@@ -0,0 +1,44 @@
+///
+//  bigfloat.h
+//  Small fixed-point arbitrary-precision numbers for the deep zoom
+//  reference orbit.
+//
+//  limb[0] is the integer part and limb[1..n-1] the fraction, most
+//  significant first, so a number with n limbs has 32*(n-1) fraction
+//  bits. Values are stored as magnitude plus sign.
+///
+#ifndef BIGFLOAT_H
+#define BIGFLOAT_H
+
+#include <stdint.h>
+
+#define BF_MAX_LIMBS 40
+
+typedef struct {
+    int neg;
+    int n;
+    uint32_t limb[BF_MAX_LIMBS];
+} bigfloat;
+
+// Number of limbs needed to resolve points pixel_size apart, with some
+// guard bits left over for the orbit to lose
+int bf_limbs_for(double pixel_size);
+
+// Parse a decimal string such as "-0.7436438870371587047521" or "1.5e-20".
+// Returns 0 on success, -1 if the string is not a number or does not fit.
+int bf_from_string(bigfloat *r, const char *str, int n);
+
+void bf_from_double(bigfloat *r, double d, int n);
+
+double bf_to_double(const bigfloat *a);
+
+// Truncate or zero-extend a to n limbs
+void bf_set_precision(bigfloat *a, int n);
+
+// r = a + b, r = a - b and r = a * b. All operands must have the same
+// number of limbs; r may alias a or b.
+void bf_add(bigfloat *r, const bigfloat *a, const bigfloat *b);
+void bf_sub(bigfloat *r, const bigfloat *a, const bigfloat *b);
+void bf_mul(bigfloat *r, const bigfloat *a, const bigfloat *b);
+
+#endif  /* Compile guard */
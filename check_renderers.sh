@@ -0,0 +1,41 @@
+#!/bin/sh
+###
+#  check_renderers.sh
+#  Render a set of views with -r bands and -r ms and compare the iteration
+#  maps of every frame. Mariani-Silver has to compute exactly what brute
+#  force does, so any difference fails the check.
+#
+#  Use: ./check_renderers.sh [path to mandel]
+###
+MANDEL=${1:-./mandel}
+DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$DIR"' EXIT
+
+failed=0
+check() {
+    rm -f "$DIR"/*
+    "$MANDEL" "$@" -r bands -i 32 -o "$DIR/bands" > /dev/null || exit 1
+    "$MANDEL" "$@" -r ms -i 32 -o "$DIR/ms" > /dev/null || exit 1
+
+    frames=0
+    differ=0
+    for map in "$DIR"/bands_*.map; do
+        frames=$((frames + 1))
+        cmp -s "$map" "$DIR/ms_${map##*/bands_}" || differ=$((differ + 1))
+    done
+    if [ "$differ" -ne 0 ]; then
+        failed=1
+    fi
+    echo "$differ of $frames frames differ: $*"
+}
+
+check -x -1.25 -y 0 -s 0.2 -W 500 -H 500 -m 2000 -c 4
+check -x -1.25 -y 0 -s 0.2 -W 500 -H 500 -m 2000 -c 4 -N -B
+check -x -0.75 -y 0.1 -s 0.05 -W 400 -H 400 -m 2000 -c 4
+check -x 0.285 -y 0.01 -s 0.02 -W 400 -H 400 -m 2000 -c 4
+check -x -0.1528 -y 1.0397 -s 0.01 -W 400 -H 400 -m 2000 -c 4
+check -x -0.5 -y 0 -s 3 -W 300 -H 200 -m 500 -c 4 -t 3
+check -x -1 -y 0 -s 0.6 -W 301 -H 301 -m 1000 -c 4
+check -x -1.7548776 -y 0 -s 0.04 -W 300 -H 300 -m 3000 -c 4 -t 2
+
+exit $failed
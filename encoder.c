@@ -0,0 +1,118 @@
+///
+//  encoder.c
+//  Encoder threads that compress and write finished frames from a
+//  bounded queue while the compute threads move on to the next frame.
+///
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "encoder.h"
+
+typedef struct {
+    imgRawImage *img;
+    char outfile[300];
+} encode_job;
+
+struct encoder {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    encode_job *queue;       // ring buffer of depth jobs
+    int head, count, depth;
+    int done;
+    int nthreads;
+    int strip_threads;
+    image_pool *images;
+    pthread_t *threads;
+};
+
+static void *encoder_thread(void *arg) {
+    encoder *enc = (encoder *)arg;
+
+    pthread_mutex_lock(&enc->lock);
+    for (;;) {
+        while (enc->count == 0 && !enc->done) {
+            pthread_cond_wait(&enc->not_empty, &enc->lock);
+        }
+        if (enc->count == 0) {
+            break;
+        }
+
+        encode_job job = enc->queue[enc->head];
+        enc->head = (enc->head + 1) % enc->depth;
+        enc->count--;
+        pthread_cond_signal(&enc->not_full);
+        pthread_mutex_unlock(&enc->lock);
+
+        storeJpegImageFileParallel(job.img, job.outfile, enc->strip_threads);
+        image_pool_put(enc->images, job.img);
+
+        pthread_mutex_lock(&enc->lock);
+    }
+    pthread_mutex_unlock(&enc->lock);
+    return NULL;
+}
+
+encoder *encoder_create(int nthreads, int depth, int strip_threads, image_pool *images) {
+    encoder *enc = calloc(1, sizeof(encoder));
+    if (enc == NULL) {
+        return NULL;
+    }
+
+    enc->depth = depth;
+    enc->strip_threads = strip_threads;
+    enc->images = images;
+    enc->queue = malloc(depth * sizeof(encode_job));
+    enc->threads = malloc(nthreads * sizeof(pthread_t));
+    if (enc->queue == NULL || enc->threads == NULL) {
+        free(enc->queue);
+        free(enc->threads);
+        free(enc);
+        return NULL;
+    }
+    pthread_mutex_init(&enc->lock, NULL);
+    pthread_cond_init(&enc->not_empty, NULL);
+    pthread_cond_init(&enc->not_full, NULL);
+
+    for (int t = 0; t < nthreads; t++) {
+        if (pthread_create(&enc->threads[t], NULL, encoder_thread, enc) != 0) {
+            encoder_finish(enc);
+            return NULL;
+        }
+        enc->nthreads++;
+    }
+    return enc;
+}
+
+void encoder_submit(encoder *enc, imgRawImage *img, const char *outfile) {
+    pthread_mutex_lock(&enc->lock);
+    while (enc->count == enc->depth) {
+        pthread_cond_wait(&enc->not_full, &enc->lock);
+    }
+
+    encode_job *job = &enc->queue[(enc->head + enc->count) % enc->depth];
+    job->img = img;
+    snprintf(job->outfile, sizeof(job->outfile), "%s", outfile);
+    enc->count++;
+    pthread_cond_signal(&enc->not_empty);
+    pthread_mutex_unlock(&enc->lock);
+}
+
+void encoder_finish(encoder *enc) {
+    pthread_mutex_lock(&enc->lock);
+    enc->done = 1;
+    pthread_cond_broadcast(&enc->not_empty);
+    pthread_mutex_unlock(&enc->lock);
+
+    for (int t = 0; t < enc->nthreads; t++) {
+        pthread_join(enc->threads[t], NULL);
+    }
+
+    pthread_mutex_destroy(&enc->lock);
+    pthread_cond_destroy(&enc->not_empty);
+    pthread_cond_destroy(&enc->not_full);
+    free(enc->queue);
+    free(enc->threads);
+    free(enc);
+}
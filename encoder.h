@@ -0,0 +1,27 @@
+///
+//  encoder.h
+//  Encoder threads that compress and write finished frames from a
+//  bounded queue while the compute threads move on to the next frame.
+///
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#include "jpegrw.h"
+#include "imgpool.h"
+
+typedef struct encoder encoder;
+
+// Start nthreads encoder threads behind a queue of depth frames, each
+// encoding its frame in strips on strip_threads threads. Written images
+// go back to images (which may be NULL).
+// Returns NULL if out of memory or threads.
+encoder *encoder_create(int nthreads, int depth, int strip_threads, image_pool *images);
+
+// Queue img to be written to outfile and given back. Blocks while the
+// queue is full, so at most depth frames wait besides the ones being encoded.
+void encoder_submit(encoder *enc, imgRawImage *img, const char *outfile);
+
+// Write every queued frame, then stop the threads
+void encoder_finish(encoder *enc);
+
+#endif  /* Compile guard */
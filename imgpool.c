@@ -0,0 +1,74 @@
+///
+//  imgpool.c
+//  Image buffers kept for reuse once a frame is written, so each frame
+//  does not pay for allocating (and page-faulting) a fresh one.
+///
+#include <stdlib.h>
+#include <pthread.h>
+#include "imgpool.h"
+
+// The pool only ever holds images that were in use at the same time, so it
+// is bounded by the most frames in flight at once and needs no limit.
+struct image_pool {
+    pthread_mutex_t lock;
+    imgRawImage **images;    // free images
+    int count, capacity;
+};
+
+image_pool *image_pool_create(void) {
+    image_pool *pool = calloc(1, sizeof(image_pool));
+    if (pool) {
+        pthread_mutex_init(&pool->lock, NULL);
+    }
+    return pool;
+}
+
+imgRawImage *image_pool_get(image_pool *pool, unsigned int width, unsigned int height) {
+    if (pool) {
+        pthread_mutex_lock(&pool->lock);
+        for (int k = pool->count - 1; k >= 0; k--) {
+            imgRawImage *img = pool->images[k];
+            if (img->width == width && img->height == height) {
+                pool->images[k] = pool->images[--pool->count];
+                pthread_mutex_unlock(&pool->lock);
+                return img;
+            }
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return initRawImage(width, height);
+}
+
+void image_pool_put(image_pool *pool, imgRawImage *img) {
+    if (pool == NULL) {
+        freeRawImage(img);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->count == pool->capacity) {
+        int capacity = pool->capacity ? 2 * pool->capacity : 4;
+        imgRawImage **images = realloc(pool->images, capacity * sizeof(imgRawImage *));
+        if (images == NULL) {
+            pthread_mutex_unlock(&pool->lock);
+            freeRawImage(img);
+            return;
+        }
+        pool->images = images;
+        pool->capacity = capacity;
+    }
+    pool->images[pool->count++] = img;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void image_pool_free(image_pool *pool) {
+    if (pool == NULL) {
+        return;
+    }
+    for (int k = 0; k < pool->count; k++) {
+        freeRawImage(pool->images[k]);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->images);
+    free(pool);
+}
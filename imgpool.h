@@ -0,0 +1,28 @@
+///
+//  imgpool.h
+//  Image buffers kept for reuse once a frame is written, so each frame
+//  does not pay for allocating (and page-faulting) a fresh one.
+///
+#ifndef IMGPOOL_H
+#define IMGPOOL_H
+
+#include "jpegrw.h"
+
+typedef struct image_pool image_pool;
+
+// Returns NULL if out of memory
+image_pool *image_pool_create(void);
+
+// A width x height image, reused from the pool when one of that size is
+// free. The pixels are left as they are: the caller writes every one.
+// With a NULL pool this is initRawImage.
+imgRawImage *image_pool_get(image_pool *pool, unsigned int width, unsigned int height);
+
+// Give img back for reuse. Safe to call from any thread. With a NULL
+// pool this is freeRawImage.
+void image_pool_put(image_pool *pool, imgRawImage *img);
+
+// Free the pool and every image in it
+void image_pool_free(image_pool *pool);
+
+#endif  /* Compile guard */
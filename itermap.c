@@ -0,0 +1,96 @@
+///
+//  itermap.c
+//  Iteration map files: the raw per-pixel iteration counts of a frame,
+//  so it can be colored again without computing it again.
+///
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "itermap.h"
+
+int itermap_write(const char *filename, const int *iters, int width, int height, int max, int bytes_per_count) {
+    itermap_header header = {0};
+    memcpy(header.magic, ITERMAP_MAGIC, sizeof(header.magic));
+    header.width = width;
+    header.height = height;
+    header.max = max;
+    header.bytes_per_count = bytes_per_count;
+
+    FILE *out = fopen(filename, "wb");
+    void *row = malloc((size_t)width * bytes_per_count);
+    if (out == NULL || row == NULL) {
+        if (out) {
+            fclose(out);
+        }
+        free(row);
+        return -1;
+    }
+
+    int result = fwrite(&header, sizeof(header), 1, out) == 1 ? 0 : -1;
+    for (int j = height - 1; j >= 0 && result == 0; j--) {
+        const int *src = iters + (size_t)j * width;
+        for (int i = 0; i < width; i++) {
+            if (bytes_per_count == 2) {
+                ((uint16_t *)row)[i] = src[i];
+            } else {
+                ((uint32_t *)row)[i] = src[i];
+            }
+        }
+        if (fwrite(row, bytes_per_count, width, out) != (size_t)width) {
+            result = -1;
+        }
+    }
+
+    free(row);
+    if (fclose(out) != 0) {
+        result = -1;
+    }
+    return result;
+}
+
+int itermap_open(itermap *map, const char *filename) {
+    struct stat st;
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(itermap_header)) {
+        close(fd);
+        return -1;
+    }
+
+    map->size = st.st_size;
+    map->base = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map->base == MAP_FAILED) {
+        return -1;
+    }
+
+    memcpy(&map->header, map->base, sizeof(itermap_header));
+    map->counts = (const char *)map->base + sizeof(itermap_header);
+    size_t expected = sizeof(itermap_header) + (size_t)map->header.width * map->header.height * map->header.bytes_per_count;
+    if (memcmp(map->header.magic, ITERMAP_MAGIC, sizeof(map->header.magic)) != 0 ||
+        (map->header.bytes_per_count != 2 && map->header.bytes_per_count != 4) ||
+        map->header.max == 0 || map->size < expected) {
+        munmap(map->base, map->size);
+        return -1;
+    }
+    return 0;
+}
+
+unsigned int itermap_get(const itermap *map, int i, int j) {
+    size_t k = (size_t)j * map->header.width + i;
+    if (map->header.bytes_per_count == 2) {
+        return ((const uint16_t *)map->counts)[k];
+    }
+    return ((const uint32_t *)map->counts)[k];
+}
+
+void itermap_close(itermap *map) {
+    munmap(map->base, map->size);
+    map->base = NULL;
+}
@@ -0,0 +1,47 @@
+///
+//  itermap.h
+//  Iteration map files: the raw per-pixel iteration counts of a frame,
+//  so it can be colored again without computing it again.
+//
+//  A map is a 32-byte header followed by width*height counts of 2 or 4
+//  bytes each, in host byte order, top row first like the image. The
+//  header keeps the counts aligned, so a mapped file can be used in place.
+///
+#ifndef ITERMAP_H
+#define ITERMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ITERMAP_MAGIC "MANDMAP1"
+
+typedef struct {
+    char magic[8];
+    uint32_t width, height;
+    uint32_t max;
+    uint32_t bytes_per_count;   // 2 or 4
+    uint32_t reserved[2];
+} itermap_header;
+
+typedef struct {
+    itermap_header header;
+    const void *counts;
+    void *base;                 // the whole mapping
+    size_t size;
+} itermap;
+
+// Write the counts of a width*height frame whose row 0 is the bottom, as
+// the renderers store them. bytes_per_count is 2 or 4; with 2, max must
+// fit in 16 bits. Returns 0 on success, -1 on errors.
+int itermap_write(const char *filename, const int *iters, int width, int height, int max, int bytes_per_count);
+
+// Map a file read-only. Returns 0 on success, -1 if it cannot be read or
+// is not a valid map.
+int itermap_open(itermap *map, const char *filename);
+
+// Count of pixel (i, j), with row 0 at the top
+unsigned int itermap_get(const itermap *map, int i, int j);
+
+void itermap_close(itermap *map);
+
+#endif  /* Compile guard */
@@ -8,11 +8,15 @@
 ///
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <immintrin.h>
 #include <jpeglib.h>    
 #include <jerror.h>
 #include "jpegrw.h"
 
 #define NUM_COMPONENTS 3   // always 3 for JPG
+#define MCU_ROWS 16        // scanlines per MCU row with the default 2x2 chroma subsampling
 
 imgRawImage* initRawImage(unsigned int width, unsigned int height)
 {
@@ -39,15 +43,16 @@ void freeRawImage(imgRawImage* img)
 void setImageRGB(imgRawImage* image,unsigned char red,unsigned char green,
 							 unsigned char blue)
 {
-	for(unsigned int i=0;i<image->width;i++)
-	{
-		for(unsigned int j=0;j<image->height;j++)
-		{
-			image->lpData[((j*image->width+i)*image->numComponents)+0] = red; 
-			image->lpData[((j*image->width+i)*image->numComponents)+1] = green;
-			image->lpData[((j*image->width+i)*image->numComponents)+2] = blue;
-		}
+	size_t rowBytes = (size_t)image->width * image->numComponents;
+
+	if(image->height == 0)
+		return;
 
+	/* fill the top row, then copy it down the image in memory order */
+	fillSpanRGB(image, 0, image->height - 1, image->width, red, green, blue);
+	for(unsigned int j=1;j<image->height;j++)
+	{
+		memcpy(image->lpData + j * rowBytes, image->lpData, rowBytes);
 	}
 }
 
@@ -77,6 +82,134 @@ void setPixelCOLOR(imgRawImage* image, unsigned int x, unsigned int y, unsigned
 	setPixelRGB(image, x, y, (rgb&0xFF0000)>>16,(rgb&0xFF00)>>8,rgb&0xFF);
 }
 
+unsigned char* getSpanRGB(imgRawImage* image, unsigned int x, unsigned int y, unsigned int* lpCount)
+{
+	if(y >= image->height || x >= image->width)
+		return NULL;
+	if(*lpCount > image->width - x)
+		*lpCount = image->width - x;
+
+	y = image->height - y - 1;
+	return &image->lpData[((size_t)y * image->width + x) * image->numComponents];
+}
+
+void fillSpanRGB(imgRawImage* image, unsigned int x, unsigned int y, unsigned int count,
+							 unsigned char red, unsigned char green, unsigned char blue)
+{
+	unsigned char* lpDst = getSpanRGB(image, x, y, &count);
+
+	if(lpDst == NULL || count == 0)
+		return;
+
+	/* one pixel by hand, then keep doubling what is already filled */
+	lpDst[0] = red;
+	lpDst[1] = green;
+	lpDst[2] = blue;
+	for(size_t done = 3, total = (size_t)count * 3; done < total; done *= 2)
+	{
+		memcpy(lpDst + done, lpDst, done < total - done ? done : total - done);
+	}
+}
+
+void fillSpanCOLOR(imgRawImage* image, unsigned int x, unsigned int y, unsigned int count, unsigned int rgb)
+{
+	fillSpanRGB(image, x, y, count, (rgb&0xFF0000)>>16,(rgb&0xFF00)>>8,rgb&0xFF);
+}
+
+void writeSpanRGB(imgRawImage* image, unsigned int x, unsigned int y, unsigned int count,
+							 const unsigned char* lpRgb)
+{
+	unsigned char* lpDst = getSpanRGB(image, x, y, &count);
+
+	if(lpDst)
+		memcpy(lpDst, lpRgb, (size_t)count * 3);
+}
+
+// Unpack 0xRRGGBB colors into RGB bytes four at a time: one 16-byte load,
+// one shuffle and one 16-byte store, of which the last 4 bytes are
+// overwritten by the next group. Returns how many colors were done.
+__attribute__((target("ssse3")))
+static unsigned int unpackColorsSSSE3(unsigned char* lpDst, const unsigned int* lpColors, unsigned int count)
+{
+	const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	unsigned int i = 0;
+
+	/* the store runs 4 bytes past the group, so stop while 2 pixels are left */
+	for(; i + 6 <= count; i += 4)
+	{
+		__m128i colors = _mm_loadu_si128((const __m128i*)(lpColors + i));
+		_mm_storeu_si128((__m128i*)(lpDst + 3 * i), _mm_shuffle_epi8(colors, shuffle));
+	}
+	return i;
+}
+
+void writeSpanCOLOR(imgRawImage* image, unsigned int x, unsigned int y, unsigned int count,
+							 const unsigned int* lpColors)
+{
+	unsigned char* lpDst = getSpanRGB(image, x, y, &count);
+	unsigned int i = 0;
+
+	if(lpDst == NULL)
+		return;
+
+	if(__builtin_cpu_supports("ssse3"))
+		i = unpackColorsSSSE3(lpDst, lpColors, count);
+	for(; i < count; i++)
+	{
+		lpDst[3 * i + 0] = (lpColors[i]&0xFF0000)>>16;
+		lpDst[3 * i + 1] = (lpColors[i]&0xFF00)>>8;
+		lpDst[3 * i + 2] = lpColors[i]&0xFF;
+	}
+}
+
+void blitImage(imgRawImage* dst, unsigned int dstX, unsigned int dstY, const imgRawImage* src,
+							 unsigned int srcX, unsigned int srcY, unsigned int width, unsigned int height)
+{
+	if(srcX >= src->width || srcY >= src->height || dstX >= dst->width || dstY >= dst->height)
+		return;
+
+	/* clip to both images */
+	if(width > src->width - srcX)
+		width = src->width - srcX;
+	if(width > dst->width - dstX)
+		width = dst->width - dstX;
+	if(height > src->height - srcY)
+		height = src->height - srcY;
+	if(height > dst->height - dstY)
+		height = dst->height - dstY;
+
+	/* copy upwards or downwards so overlapping rows are read before they are written */
+	for(unsigned int k = 0; k < height; k++)
+	{
+		unsigned int row = dstY > srcY ? height - 1 - k : k;
+		size_t srcRow = src->height - (srcY + row) - 1;
+		size_t dstRow = dst->height - (dstY + row) - 1;
+
+		memmove(&dst->lpData[(dstRow * dst->width + dstX) * 3],
+				&src->lpData[(srcRow * src->width + srcX) * 3], (size_t)width * 3);
+	}
+}
+
+void flipImageY(imgRawImage* image)
+{
+	size_t rowBytes = (size_t)image->width * image->numComponents;
+	unsigned char* lpRow;
+
+	if(image->height < 2)
+		return;
+	lpRow = (unsigned char*)malloc(rowBytes);
+	if(lpRow == NULL)
+		return;
+
+	for(unsigned int top = 0, bottom = image->height - 1; top < bottom; top++, bottom--)
+	{
+		memcpy(lpRow, &image->lpData[top * rowBytes], rowBytes);
+		memcpy(&image->lpData[top * rowBytes], &image->lpData[bottom * rowBytes], rowBytes);
+		memcpy(&image->lpData[bottom * rowBytes], lpRow, rowBytes);
+	}
+	free(lpRow);
+}
+
 
 
 imgRawImage* loadJpegImageFile(const char* lpFilename) 
@@ -192,3 +325,232 @@ int storeJpegImageFile(const imgRawImage* lpImage,const char* lpFilename)
 	jpeg_destroy_compress(&info);
 	return 0;
 }
+
+
+
+struct jpegWriter {
+	struct jpeg_compress_struct info;
+	struct jpeg_error_mgr err;
+	FILE* fHandle;
+};
+
+jpegWriter* openJpegWriter(const char* lpFilename, unsigned int width, unsigned int height)
+{
+	jpegWriter* writer = (jpegWriter*)malloc(sizeof(jpegWriter));
+
+	if(writer == NULL)
+		return NULL;
+
+	writer->fHandle = fopen(lpFilename, "wb");
+	if(writer->fHandle == NULL) {
+		#ifdef DEBUG
+			fprintf(stderr, "%s:%u Failed to open output file %s\n", __FILE__, __LINE__, lpFilename);
+		#endif
+		free(writer);
+		return NULL;
+	}
+
+	writer->info.err = jpeg_std_error(&writer->err);
+	jpeg_create_compress(&writer->info);
+	jpeg_stdio_dest(&writer->info, writer->fHandle);
+
+	writer->info.image_width = width;
+	writer->info.image_height = height;
+	writer->info.input_components = 3;
+	writer->info.in_color_space = JCS_RGB;
+
+	jpeg_set_defaults(&writer->info);
+	jpeg_set_quality(&writer->info, 100, TRUE);
+
+	jpeg_start_compress(&writer->info, TRUE);
+	return writer;
+}
+
+void writeJpegRows(jpegWriter* writer, const unsigned char* lpRows, unsigned int numRows)
+{
+	unsigned char* lpRowBuffer[1];
+
+	for(unsigned int k = 0; k < numRows && writer->info.next_scanline < writer->info.image_height; k++) {
+		lpRowBuffer[0] = (unsigned char*)&lpRows[(size_t)k * writer->info.image_width * 3];
+		jpeg_write_scanlines(&writer->info, lpRowBuffer, 1);
+	}
+}
+
+int closeJpegWriter(jpegWriter* writer)
+{
+	int result;
+
+	jpeg_finish_compress(&writer->info);
+	result = ferror(writer->fHandle) != 0;
+	if(fclose(writer->fHandle) != 0)
+		result = 1;
+
+	jpeg_destroy_compress(&writer->info);
+	free(writer);
+	return result;
+}
+
+
+
+// One horizontal strip of a parallel encode, compressed to memory as a
+// JPEG of its own with a restart marker after every MCU row
+typedef struct {
+	const imgRawImage* lpImage;
+	unsigned int firstRow, numRows;
+	unsigned char* lpData;
+	unsigned long dwSize;
+} jpegStrip;
+
+static void* encodeJpegStrip(void* arg)
+{
+	jpegStrip* strip = (jpegStrip*)arg;
+	const imgRawImage* lpImage = strip->lpImage;
+	struct jpeg_compress_struct info;
+	struct jpeg_error_mgr err;
+	unsigned char* lpRowBuffer[1];
+
+	info.err = jpeg_std_error(&err);
+	jpeg_create_compress(&info);
+
+	strip->lpData = NULL;
+	strip->dwSize = 0;
+	jpeg_mem_dest(&info, &strip->lpData, &strip->dwSize);
+
+	info.image_width = lpImage->width;
+	info.image_height = strip->numRows;
+	info.input_components = 3;
+	info.in_color_space = JCS_RGB;
+
+	jpeg_set_defaults(&info);
+	jpeg_set_quality(&info, 100, TRUE);
+	info.restart_in_rows = 1;
+
+	jpeg_start_compress(&info, TRUE);
+
+	while(info.next_scanline < info.image_height) {
+		lpRowBuffer[0] = &(lpImage->lpData[(strip->firstRow + info.next_scanline) * (lpImage->width * 3)]);
+		jpeg_write_scanlines(&info, lpRowBuffer, 1);
+	}
+
+	jpeg_finish_compress(&info);
+	jpeg_destroy_compress(&info);
+	return NULL;
+}
+
+// Offset of the first entropy-coded byte, just past the SOS segment.
+// *lpSof is set to the offset of the SOF0 marker.
+static unsigned long findJpegScan(const unsigned char* lpData, unsigned long dwSize, unsigned long* lpSof)
+{
+	unsigned long pos = 2;	/* skip SOI */
+
+	while(pos + 4 <= dwSize && lpData[pos] == 0xFF) {
+		unsigned int marker = lpData[pos + 1];
+		unsigned long length = (lpData[pos + 2] << 8) | lpData[pos + 3];
+
+		if(marker == 0xC0) {
+			*lpSof = pos;
+		}
+		pos += 2 + length;
+		if(marker == 0xDA) {
+			return pos;
+		}
+	}
+	return 0;
+}
+
+int storeJpegImageFileParallel(const imgRawImage* lpImage, const char* lpFilename, int numThreads)
+{
+	unsigned int mcuRows = (lpImage->height + MCU_ROWS - 1) / MCU_ROWS;
+	unsigned int numStrips = numThreads < (int)mcuRows ? (unsigned int)numThreads : mcuRows;
+
+	if(numStrips <= 1) {
+		return storeJpegImageFile(lpImage, lpFilename);
+	}
+
+	unsigned int stripMcuRows = (mcuRows + numStrips - 1) / numStrips;
+	numStrips = (mcuRows + stripMcuRows - 1) / stripMcuRows;
+
+	jpegStrip strips[numStrips];
+	pthread_t threads[numStrips];
+	int started[numStrips];
+
+	for(unsigned int k = 0; k < numStrips; k++) {
+		strips[k].lpImage = lpImage;
+		strips[k].firstRow = k * stripMcuRows * MCU_ROWS;
+		strips[k].numRows = stripMcuRows * MCU_ROWS;
+		if(strips[k].firstRow + strips[k].numRows > lpImage->height) {
+			strips[k].numRows = lpImage->height - strips[k].firstRow;
+		}
+		started[k] = pthread_create(&threads[k], NULL, encodeJpegStrip, &strips[k]) == 0;
+		if(!started[k]) {
+			encodeJpegStrip(&strips[k]);
+		}
+	}
+	for(unsigned int k = 0; k < numStrips; k++) {
+		if(started[k]) {
+			pthread_join(threads[k], NULL);
+		}
+	}
+
+	FILE* fHandle = fopen(lpFilename, "wb");
+	if(fHandle == NULL) {
+		#ifdef DEBUG
+			fprintf(stderr, "%s:%u Failed to open output file %s\n", __FILE__, __LINE__, lpFilename);
+		#endif
+		for(unsigned int k = 0; k < numStrips; k++) {
+			free(strips[k].lpData);
+		}
+		return 1;
+	}
+
+	/*
+	 * Every strip was encoded with the same tables and a restart interval of
+	 * one MCU row, so the entropy-coded data of the strips can follow each
+	 * other under the headers of the first one. Only the image height in the
+	 * frame header changes, the restart markers inside each strip are
+	 * renumbered to continue the sequence, and one more restart marker goes
+	 * between strips.
+	 */
+	unsigned long sofPos = 0;
+	unsigned long scanPos = findJpegScan(strips[0].lpData, strips[0].dwSize, &sofPos);
+	unsigned char* lpHeader = strips[0].lpData;
+	unsigned int restarts = 0;
+	int result = 0;
+
+	if(scanPos == 0 || sofPos == 0) {
+		result = 1;
+	} else {
+		lpHeader[sofPos + 5] = (lpImage->height >> 8) & 0xFF;
+		lpHeader[sofPos + 6] = lpImage->height & 0xFF;
+		fwrite(lpHeader, 1, scanPos, fHandle);
+	}
+
+	for(unsigned int k = 0; k < numStrips && result == 0; k++) {
+		unsigned long dummy;
+		unsigned char* lpData = strips[k].lpData;
+		unsigned long begin = k == 0 ? scanPos : findJpegScan(lpData, strips[k].dwSize, &dummy);
+		unsigned long end = strips[k].dwSize - 2;	/* drop EOI */
+
+		for(unsigned long pos = begin; pos + 1 < end; pos++) {
+			if(lpData[pos] == 0xFF && lpData[pos + 1] >= 0xD0 && lpData[pos + 1] <= 0xD7) {
+				lpData[pos + 1] = 0xD0 + (restarts++ & 7);
+				pos++;
+			}
+		}
+		fwrite(lpData + begin, 1, end - begin, fHandle);
+
+		if(k + 1 < numStrips) {
+			unsigned char rst[2] = { 0xFF, 0xD0 + (restarts++ & 7) };
+			fwrite(rst, 1, 2, fHandle);
+		}
+	}
+
+	unsigned char eoi[2] = { 0xFF, 0xD9 };
+	fwrite(eoi, 1, 2, fHandle);
+	fclose(fHandle);
+
+	for(unsigned int k = 0; k < numStrips; k++) {
+		free(strips[k].lpData);
+	}
+	return result;
+}
@@ -15,6 +15,23 @@ imgRawImage* loadJpegImageFile(const char* fname);
 // writes out jpeg
 int storeJpegImageFile(const imgRawImage* img, const char* lpFilename);
 
+// writes out jpeg, encoding horizontal strips on up to numThreads threads.
+// The strips are joined with restart markers into one baseline jpeg.
+int storeJpegImageFileParallel(const imgRawImage* img, const char* lpFilename, int numThreads);
+
+// writes out a jpeg a few rows at a time, so the whole image never has
+// to be in memory
+typedef struct jpegWriter jpegWriter;
+
+// opens lpFilename for a width x height jpeg - NULL if it cannot be written
+jpegWriter* openJpegWriter(const char* lpFilename, unsigned int width, unsigned int height);
+
+// writes the next numRows rows, top row first, as packed RGB bytes
+void writeJpegRows(jpegWriter* writer, const unsigned char* lpRows, unsigned int numRows);
+
+// finishes the file once every row is written - nonzero if that failed
+int closeJpegWriter(jpegWriter* writer);
+
 // A few functions to manage raw images
 imgRawImage* initRawImage(unsigned int width, unsigned int height);
 
@@ -32,5 +49,35 @@ void setPixelRGB(imgRawImage* image, unsigned int x, unsigned int y,
 							 
 void setPixelCOLOR(imgRawImage* image, unsigned int x, unsigned int y, unsigned int rgb);
 
+// Bulk raster functions. As with setPixelRGB, y counts from the bottom
+// row, and whatever falls outside the image is left out.
+
+// pointer to pixel x of row y, for writing a span of packed RGB bytes in
+// place. *lpCount is cut down to the pixels left in the row; NULL if
+// (x, y) is outside the image.
+unsigned char* getSpanRGB(imgRawImage* image, unsigned int x, unsigned int y, unsigned int* lpCount);
+
+// fill count pixels of row y from column x with one color
+void fillSpanRGB(imgRawImage* image, unsigned int x, unsigned int y, unsigned int count,
+							 unsigned char red, unsigned char green, unsigned char blue);
+
+void fillSpanCOLOR(imgRawImage* image, unsigned int x, unsigned int y, unsigned int count, unsigned int rgb);
+
+// copy count pixels of packed RGB bytes into row y from column x
+void writeSpanRGB(imgRawImage* image, unsigned int x, unsigned int y, unsigned int count,
+							 const unsigned char* lpRgb);
+
+// write count 0xRRGGBB colors into row y from column x
+void writeSpanCOLOR(imgRawImage* image, unsigned int x, unsigned int y, unsigned int count,
+							 const unsigned int* lpColors);
+
+// copy the width x height rectangle at (srcX, srcY) of src to (dstX, dstY)
+// of dst. src and dst may be the same image, and the rectangles may overlap.
+void blitImage(imgRawImage* dst, unsigned int dstX, unsigned int dstY, const imgRawImage* src,
+							 unsigned int srcX, unsigned int srcY, unsigned int width, unsigned int height);
+
+// turn the image upside down
+void flipImageY(imgRawImage* image);
+
 
 #endif  /* Compile guard */
\ No newline at end of file
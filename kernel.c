@@ -0,0 +1,521 @@
+///
+//  kernel.c
+//  Escape-time kernels for the Mandelbrot generator.
+//
+//  The vector kernels iterate one lane per pixel and keep a per-lane
+//  escape mask, so every lane produces exactly the count the scalar
+//  kernel would. Build with -ffp-contract=off to keep it that way.
+///
+#include <string.h>
+#include <math.h>
+#include <immintrin.h>
+#include "kernel.h"
+
+// Points are filtered through the interior tests in chunks of this size
+#define ROW_CHUNK 256
+
+// Iteration at which cycle detection first saves the orbit point
+#define PERIOD_FIRST_CHECK 8
+
+// Cycle tolerance as a fraction of the distance between pixels
+#define PERIOD_TOLERANCE 1e-3
+
+// Point kernels return how many points were caught by cycle detection.
+// Point i is (xs[i], ys[i]); eps is the cycle tolerance, 0 disables the check.
+typedef int (*point_kernel_fn)(const double *xs, const double *ys, int count, int max, double eps, int *iters);
+
+static int points_scalar(const double *xs, const double *ys, int count, int max, double eps, int *iters);
+
+typedef void (*row_dd_kernel_fn)(const double *xs_hi, const double *xs_lo, dd_real y, int count, int max, int *iters);
+
+static void row_dd_scalar(const double *xs_hi, const double *xs_lo, dd_real y, int count, int max, int *iters);
+
+static point_kernel_fn point_kernel = points_scalar;
+static row_dd_kernel_fn row_dd_kernel = row_dd_scalar;
+static int kernel_options = KERNEL_OPT_BULB_CHECK | KERNEL_OPT_PERIODICITY;
+
+// Calculate the number of iterations at a point
+int iterations_at_point(double x, double y, int max) {
+    double x0 = x;
+    double y0 = y;
+    int iter = 0;
+
+    while ((x * x + y * y <= 4) && iter < max) {
+        double xt = x * x - y * y + x0;
+        double yt = 2 * x * y + y0;
+        x = xt;
+        y = yt;
+        iter++;
+    }
+
+    return iter;
+}
+
+// Same loop as iterations_at_point with Brent-style cycle detection: the
+// orbit is compared against a saved point that is moved forward at every
+// power of two, so a cycle of any length is found within twice its
+// length. A point whose orbit returns within eps is treated as interior.
+static int iterations_at_point_periodic(double x, double y, int max, double eps, int *periodic) {
+    double x0 = x;
+    double y0 = y;
+    double sx = x, sy = y;
+    int check = PERIOD_FIRST_CHECK;
+    int iter = 0;
+
+    while ((x * x + y * y <= 4) && iter < max) {
+        double xt = x * x - y * y + x0;
+        double yt = 2 * x * y + y0;
+        x = xt;
+        y = yt;
+        iter++;
+
+        if (fabs(x - sx) + fabs(y - sy) < eps) {
+            *periodic = 1;
+            return max;
+        }
+        if (iter == check) {
+            sx = x;
+            sy = y;
+            check *= 2;
+        }
+    }
+
+    return iter;
+}
+
+static int points_scalar(const double *xs, const double *ys, int count, int max, double eps, int *iters) {
+    int periodic = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (eps > 0) {
+            int found = 0;
+            iters[i] = iterations_at_point_periodic(xs[i], ys[i], max, eps, &found);
+            periodic += found;
+        } else {
+            iters[i] = iterations_at_point(xs[i], ys[i], max);
+        }
+    }
+
+    return periodic;
+}
+
+// Copy the last, partial group of points into full-width buffers by
+// repeating the final point, so the tail still runs on the vector path
+static inline int pad_lanes(const double *xs, const double *ys, int i, int count, int lanes,
+                            double *xbuf, double *ybuf) {
+    int valid = count - i < lanes ? count - i : lanes;
+    for (int k = 0; k < lanes; k++) {
+        int from = i + (k < valid ? k : valid - 1);
+        xbuf[k] = xs[from];
+        ybuf[k] = ys[from];
+    }
+    return valid;
+}
+
+__attribute__((target("avx2")))
+static int points_avx2(const double *xs, const double *ys, int count, int max, double eps, int *iters) {
+    const __m256d four = _mm256_set1_pd(4.0);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d veps = _mm256_set1_pd(eps);
+    const __m256d vmax = _mm256_set1_pd(max);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    int periodic = 0;
+
+    for (int i = 0; i < count; i += 4) {
+        double xbuf[4], ybuf[4];
+        int out[4];
+        int valid = pad_lanes(xs, ys, i, count, 4, xbuf, ybuf);
+        __m256d x0 = _mm256_loadu_pd(xbuf);
+        __m256d y0 = _mm256_loadu_pd(ybuf);
+        __m256d zx = x0;
+        __m256d zy = y0;
+        __m256d sx = zx;
+        __m256d sy = zy;
+        __m256d n = _mm256_setzero_pd();
+        __m256d active = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        __m256d cycled = _mm256_setzero_pd();
+        int check = PERIOD_FIRST_CHECK;
+
+        for (int k = 0; k < max; k++) {
+            __m256d x2 = _mm256_mul_pd(zx, zx);
+            __m256d y2 = _mm256_mul_pd(zy, zy);
+            // Once a lane escapes it stays masked off, even if its values overflow
+            active = _mm256_and_pd(active, _mm256_cmp_pd(_mm256_add_pd(x2, y2), four, _CMP_LE_OQ));
+            if (_mm256_movemask_pd(active) == 0) {
+                break;
+            }
+            n = _mm256_add_pd(n, _mm256_and_pd(active, one));
+            __m256d xt = _mm256_add_pd(_mm256_sub_pd(x2, y2), x0);
+            zy = _mm256_add_pd(_mm256_mul_pd(_mm256_add_pd(zx, zx), zy), y0);
+            zx = xt;
+
+            if (eps > 0) {
+                __m256d dist = _mm256_add_pd(_mm256_andnot_pd(sign, _mm256_sub_pd(zx, sx)),
+                                             _mm256_andnot_pd(sign, _mm256_sub_pd(zy, sy)));
+                __m256d hit = _mm256_and_pd(active, _mm256_cmp_pd(dist, veps, _CMP_LT_OQ));
+                if (_mm256_movemask_pd(hit) != 0) {
+                    cycled = _mm256_or_pd(cycled, hit);
+                    active = _mm256_andnot_pd(hit, active);
+                }
+                if (k + 1 == check) {
+                    sx = zx;
+                    sy = zy;
+                    check *= 2;
+                }
+            }
+        }
+
+        periodic += __builtin_popcount(_mm256_movemask_pd(cycled) & ((1 << valid) - 1));
+        n = _mm256_blendv_pd(n, vmax, cycled);
+        _mm_storeu_si128((__m128i *)out, _mm256_cvtpd_epi32(n));
+        memcpy(iters + i, out, valid * sizeof(int));
+    }
+
+    return periodic;
+}
+
+__attribute__((target("avx512f")))
+static int points_avx512(const double *xs, const double *ys, int count, int max, double eps, int *iters) {
+    const __m512d four = _mm512_set1_pd(4.0);
+    const __m512d one = _mm512_set1_pd(1.0);
+    const __m512d veps = _mm512_set1_pd(eps);
+    const __m512d vmax = _mm512_set1_pd(max);
+    int periodic = 0;
+
+    for (int i = 0; i < count; i += 8) {
+        double xbuf[8], ybuf[8];
+        int out[8];
+        int valid = pad_lanes(xs, ys, i, count, 8, xbuf, ybuf);
+        __m512d x0 = _mm512_loadu_pd(xbuf);
+        __m512d y0 = _mm512_loadu_pd(ybuf);
+        __m512d zx = x0;
+        __m512d zy = y0;
+        __m512d sx = zx;
+        __m512d sy = zy;
+        __m512d n = _mm512_setzero_pd();
+        __mmask8 active = 0xFF;
+        __mmask8 cycled = 0;
+        int check = PERIOD_FIRST_CHECK;
+
+        for (int k = 0; k < max; k++) {
+            __m512d x2 = _mm512_mul_pd(zx, zx);
+            __m512d y2 = _mm512_mul_pd(zy, zy);
+            active = _mm512_mask_cmp_pd_mask(active, _mm512_add_pd(x2, y2), four, _CMP_LE_OQ);
+            if (active == 0) {
+                break;
+            }
+            n = _mm512_mask_add_pd(n, active, n, one);
+            __m512d xt = _mm512_add_pd(_mm512_sub_pd(x2, y2), x0);
+            zy = _mm512_add_pd(_mm512_mul_pd(_mm512_add_pd(zx, zx), zy), y0);
+            zx = xt;
+
+            if (eps > 0) {
+                __m512d dist = _mm512_add_pd(_mm512_abs_pd(_mm512_sub_pd(zx, sx)),
+                                             _mm512_abs_pd(_mm512_sub_pd(zy, sy)));
+                __mmask8 hit = _mm512_mask_cmp_pd_mask(active, dist, veps, _CMP_LT_OQ);
+                cycled |= hit;
+                active &= ~hit;
+                if (k + 1 == check) {
+                    sx = zx;
+                    sy = zy;
+                    check *= 2;
+                }
+            }
+        }
+
+        periodic += __builtin_popcount(cycled & ((1 << valid) - 1));
+        n = _mm512_mask_blend_pd(cycled, n, vmax);
+        _mm256_storeu_si256((__m256i *)out, _mm512_cvtpd_epi32(n));
+        memcpy(iters + i, out, valid * sizeof(int));
+    }
+
+    return periodic;
+}
+
+// Double-double arithmetic (Dekker / Knuth error-free transformations).
+// These rely on every operation being rounded on its own, which is why
+// the file must not be built with floating-point contraction.
+
+static inline dd_real quick_two_sum(double a, double b) {
+    dd_real r;
+    r.hi = a + b;
+    r.lo = b - (r.hi - a);
+    return r;
+}
+
+static inline dd_real two_sum(double a, double b) {
+    dd_real r;
+    r.hi = a + b;
+    double bb = r.hi - a;
+    r.lo = (a - (r.hi - bb)) + (b - bb);
+    return r;
+}
+
+// Split a into two halves of 26 bits so their products are exact
+static inline void split(double a, double *hi, double *lo) {
+    double t = 134217729.0 * a;  // 2^27 + 1
+    *hi = t - (t - a);
+    *lo = a - *hi;
+}
+
+static inline dd_real two_prod(double a, double b) {
+    double ah, al, bh, bl;
+    dd_real r;
+    split(a, &ah, &al);
+    split(b, &bh, &bl);
+    r.hi = a * b;
+    r.lo = ((ah * bh - r.hi) + ah * bl + al * bh) + al * bl;
+    return r;
+}
+
+static inline dd_real dd_add(dd_real a, dd_real b) {
+    dd_real s = two_sum(a.hi, b.hi);
+    return quick_two_sum(s.hi, s.lo + a.lo + b.lo);
+}
+
+static inline dd_real dd_sub(dd_real a, dd_real b) {
+    b.hi = -b.hi;
+    b.lo = -b.lo;
+    return dd_add(a, b);
+}
+
+static inline dd_real dd_mul(dd_real a, dd_real b) {
+    dd_real p = two_prod(a.hi, b.hi);
+    return quick_two_sum(p.hi, p.lo + (a.hi * b.lo + a.lo * b.hi));
+}
+
+dd_real dd_add_double(dd_real a, double b) {
+    dd_real s = two_sum(a.hi, b);
+    return quick_two_sum(s.hi, s.lo + a.lo);
+}
+
+static int iterations_at_point_dd(dd_real x0, dd_real y0, int max) {
+    dd_real x = x0, y = y0;
+    int iter = 0;
+
+    while ((x.hi * x.hi + y.hi * y.hi <= 4) && iter < max) {
+        dd_real xt = dd_add(dd_sub(dd_mul(x, x), dd_mul(y, y)), x0);
+        dd_real yt = dd_add(dd_mul(dd_add(x, x), y), y0);
+        x = xt;
+        y = yt;
+        iter++;
+    }
+
+    return iter;
+}
+
+static void row_dd_scalar(const double *xs_hi, const double *xs_lo, dd_real y, int count, int max, int *iters) {
+    for (int i = 0; i < count; i++) {
+        dd_real x = { xs_hi[i], xs_lo[i] };
+        iters[i] = iterations_at_point_dd(x, y, max);
+    }
+}
+
+// Vector double-double: each lane holds one pixel as a (hi, lo) register pair.
+// two_prod uses FMA instead of splitting.
+typedef struct {
+    __m256d hi, lo;
+} dd4;
+
+__attribute__((target("avx2,fma")))
+static inline dd4 quick_two_sum4(__m256d a, __m256d b) {
+    dd4 r;
+    r.hi = _mm256_add_pd(a, b);
+    r.lo = _mm256_sub_pd(b, _mm256_sub_pd(r.hi, a));
+    return r;
+}
+
+__attribute__((target("avx2,fma")))
+static inline dd4 dd_add4(dd4 a, dd4 b) {
+    __m256d s = _mm256_add_pd(a.hi, b.hi);
+    __m256d bb = _mm256_sub_pd(s, a.hi);
+    __m256d e = _mm256_add_pd(_mm256_sub_pd(a.hi, _mm256_sub_pd(s, bb)), _mm256_sub_pd(b.hi, bb));
+    return quick_two_sum4(s, _mm256_add_pd(_mm256_add_pd(e, a.lo), b.lo));
+}
+
+__attribute__((target("avx2,fma")))
+static inline dd4 dd_mul4(dd4 a, dd4 b) {
+    __m256d p = _mm256_mul_pd(a.hi, b.hi);
+    __m256d e = _mm256_fmsub_pd(a.hi, b.hi, p);
+    __m256d cross = _mm256_add_pd(_mm256_mul_pd(a.hi, b.lo), _mm256_mul_pd(a.lo, b.hi));
+    return quick_two_sum4(p, _mm256_add_pd(e, cross));
+}
+
+__attribute__((target("avx2,fma")))
+static void row_dd_avx2(const double *xs_hi, const double *xs_lo, dd_real y, int count, int max, int *iters) {
+    const __m256d four = _mm256_set1_pd(4.0);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    const dd4 y0 = { _mm256_set1_pd(y.hi), _mm256_set1_pd(y.lo) };
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        dd4 x0 = { _mm256_loadu_pd(xs_hi + i), _mm256_loadu_pd(xs_lo + i) };
+        dd4 zx = x0, zy = y0;
+        __m256d n = _mm256_setzero_pd();
+        __m256d active = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+
+        for (int k = 0; k < max; k++) {
+            __m256d mag = _mm256_add_pd(_mm256_mul_pd(zx.hi, zx.hi), _mm256_mul_pd(zy.hi, zy.hi));
+            active = _mm256_and_pd(active, _mm256_cmp_pd(mag, four, _CMP_LE_OQ));
+            if (_mm256_movemask_pd(active) == 0) {
+                break;
+            }
+            n = _mm256_add_pd(n, _mm256_and_pd(active, one));
+
+            dd4 x2 = dd_mul4(zx, zx);
+            dd4 y2 = dd_mul4(zy, zy);
+            dd4 ny2 = { _mm256_xor_pd(y2.hi, sign), _mm256_xor_pd(y2.lo, sign) };
+            dd4 twox = { _mm256_add_pd(zx.hi, zx.hi), _mm256_add_pd(zx.lo, zx.lo) };
+            zy = dd_add4(dd_mul4(twox, zy), y0);
+            zx = dd_add4(dd_add4(x2, ny2), x0);
+        }
+
+        _mm_storeu_si128((__m128i *)(iters + i), _mm256_cvtpd_epi32(n));
+    }
+
+    row_dd_scalar(xs_hi + i, xs_lo + i, y, count - i, max, iters + i);
+}
+
+void iterations_row_dd(const double *xs_hi, const double *xs_lo, dd_real y, int count, int max, int *iters) {
+    row_dd_kernel(xs_hi, xs_lo, y, count, max, iters);
+}
+
+// Points inside the main cardioid never escape
+static inline int in_cardioid(double x, double y) {
+    double xq = x - 0.25;
+    double q = xq * xq + y * y;
+    return q * (q + xq) <= 0.25 * y * y;
+}
+
+// Points inside the period-2 bulb centered at -1 never escape
+static inline int in_bulb(double x, double y) {
+    double xb = x + 1;
+    return xb * xb + y * y <= 0.0625;
+}
+
+void iterations_points(const kernel_params *params, const double *xs, const double *ys, int count, int *iters, kernel_stats *stats) {
+    int max = params->max;
+    double eps = (kernel_options & KERNEL_OPT_PERIODICITY) ? params->pixel_size * PERIOD_TOLERANCE : 0;
+    int bulb_check = kernel_options & KERNEL_OPT_BULB_CHECK;
+    int validate = kernel_options & KERNEL_OPT_VALIDATE;
+
+    // Resolve interior points up front and pack the rest together, so the
+    // vector lanes are not held up by pixels that would run to max anyway
+    double packed_x[ROW_CHUNK], packed_y[ROW_CHUNK];
+    int packed_iters[ROW_CHUNK];
+    int packed_index[ROW_CHUNK];
+    int plain_iters[ROW_CHUNK];
+    kernel_stats counts = {0};
+
+    for (int start = 0; start < count; start += ROW_CHUNK) {
+        int end = start + ROW_CHUNK < count ? start + ROW_CHUNK : count;
+        int packed = 0;
+
+        for (int i = start; i < end; i++) {
+            if (bulb_check && in_cardioid(xs[i], ys[i])) {
+                iters[i] = max;
+                counts.cardioid++;
+            } else if (bulb_check && in_bulb(xs[i], ys[i])) {
+                iters[i] = max;
+                counts.bulb++;
+            } else {
+                packed_x[packed] = xs[i];
+                packed_y[packed] = ys[i];
+                packed_index[packed] = i;
+                packed++;
+            }
+        }
+
+        counts.periodic += point_kernel(packed_x, packed_y, packed, max, eps, packed_iters);
+        for (int p = 0; p < packed; p++) {
+            iters[packed_index[p]] = packed_iters[p];
+        }
+
+        // Compare against the same kernel with every shortcut turned off
+        if (validate) {
+            point_kernel(xs + start, ys + start, end - start, max, 0, plain_iters);
+            for (int i = start; i < end; i++) {
+                counts.validated++;
+                if (iters[i] != plain_iters[i - start]) {
+                    counts.mismatched++;
+                }
+            }
+        }
+    }
+
+    if (stats) {
+        kernel_stats_add(stats, &counts);
+    }
+}
+
+void iterations_row(const kernel_params *params, const double *xs, double y, int count, int *iters, kernel_stats *stats) {
+    double ys[ROW_CHUNK];
+
+    for (int i = 0; i < ROW_CHUNK; i++) {
+        ys[i] = y;
+    }
+    for (int start = 0; start < count; start += ROW_CHUNK) {
+        int n = count - start < ROW_CHUNK ? count - start : ROW_CHUNK;
+        iterations_points(params, xs + start, ys, n, iters + start, stats);
+    }
+}
+
+void kernel_set_options(int options) {
+    kernel_options = options;
+}
+
+int kernel_get_options(void) {
+    return kernel_options;
+}
+
+void kernel_stats_add(kernel_stats *dst, const kernel_stats *src) {
+    dst->cardioid += src->cardioid;
+    dst->bulb += src->bulb;
+    dst->periodic += src->periodic;
+    dst->rebased += src->rebased;
+    dst->skipped += src->skipped;
+    dst->filled += src->filled;
+    dst->validated += src->validated;
+    dst->mismatched += src->mismatched;
+}
+
+int kernel_parse(const char *name) {
+    if (strcmp(name, "auto") == 0) return KERNEL_AUTO;
+    if (strcmp(name, "scalar") == 0) return KERNEL_SCALAR;
+    if (strcmp(name, "avx2") == 0) return KERNEL_AVX2;
+    if (strcmp(name, "avx512") == 0) return KERNEL_AVX512;
+    return -1;
+}
+
+const char *kernel_name(kernel_type kernel) {
+    switch (kernel) {
+        case KERNEL_SCALAR: return "scalar";
+        case KERNEL_AVX2:   return "avx2";
+        case KERNEL_AVX512: return "avx512";
+        default:            return "auto";
+    }
+}
+
+kernel_type kernel_select(kernel_type requested) {
+    __builtin_cpu_init();
+    int has_avx2 = __builtin_cpu_supports("avx2");
+    int has_avx512 = __builtin_cpu_supports("avx512f");
+    int has_fma = __builtin_cpu_supports("fma");
+
+    if (requested == KERNEL_AUTO) {
+        requested = has_avx512 ? KERNEL_AVX512 : has_avx2 ? KERNEL_AVX2 : KERNEL_SCALAR;
+    }
+    if ((requested == KERNEL_AVX512 && !has_avx512) || (requested == KERNEL_AVX2 && !has_avx2)) {
+        requested = KERNEL_SCALAR;
+    }
+
+    switch (requested) {
+        case KERNEL_AVX512: point_kernel = points_avx512; break;
+        case KERNEL_AVX2:   point_kernel = points_avx2;   break;
+        default:            point_kernel = points_scalar; break;
+    }
+    // The double-double kernel only comes in a 4-lane FMA version
+    row_dd_kernel = (requested != KERNEL_SCALAR && has_avx2 && has_fma) ? row_dd_avx2 : row_dd_scalar;
+    return requested;
+}
@@ -0,0 +1,82 @@
+///
+//  kernel.h
+//  Escape-time kernels for the Mandelbrot generator.
+//
+//  A scalar kernel is always available; AVX2 (4 lanes) and AVX-512
+//  (8 lanes) kernels are picked at runtime through CPUID.
+///
+#ifndef KERNEL_H
+#define KERNEL_H
+
+typedef enum {
+    KERNEL_AUTO = 0,
+    KERNEL_SCALAR,
+    KERNEL_AVX2,
+    KERNEL_AVX512
+} kernel_type;
+
+// Shortcuts applied by iterations_row in front of the iteration loop
+#define KERNEL_OPT_BULB_CHECK  0x1  // closed-form main cardioid / period-2 bulb test
+#define KERNEL_OPT_PERIODICITY 0x2  // Brent cycle detection for interior points
+#define KERNEL_OPT_VALIDATE    0x4  // recompute every row without shortcuts and compare
+
+// Double-double number: the value is hi + lo with |lo| at most half an ulp of hi
+typedef struct {
+    double hi, lo;
+} dd_real;
+
+// Per-frame inputs shared by every row of the frame
+typedef struct {
+    int max;            // maximum number of iterations per point
+    double pixel_size;  // distance between neighbouring pixels, sets the cycle tolerance
+} kernel_params;
+
+// Per-thread counters of how many pixels each shortcut resolved
+typedef struct {
+    unsigned long cardioid;
+    unsigned long bulb;
+    unsigned long periodic;
+    unsigned long rebased;     // perturbation: times a pixel rebased onto the reference orbit
+    unsigned long skipped;     // perturbation: iterations skipped by the series approximation
+    unsigned long filled;      // pixels filled by a renderer without calling the kernel
+    unsigned long validated;   // pixels checked against the plain kernel
+    unsigned long mismatched;  // pixels whose count differed from the plain kernel
+} kernel_stats;
+
+// Parse a kernel name (auto, scalar, avx2, avx512) - returns -1 if unknown
+int kernel_parse(const char *name);
+
+const char *kernel_name(kernel_type kernel);
+
+// Select the kernel used by iterations_row and iterations_points. KERNEL_AUTO picks the widest
+// kernel the CPU supports; unsupported requests fall back to scalar.
+// Returns the kernel actually selected.
+kernel_type kernel_select(kernel_type requested);
+
+// Enable or disable the KERNEL_OPT_* options (shortcuts enabled by default)
+void kernel_set_options(int options);
+
+int kernel_get_options(void);
+
+// Add the counters in src to dst
+void kernel_stats_add(kernel_stats *dst, const kernel_stats *src);
+
+// Calculate the number of iterations at a single point, without shortcuts
+int iterations_at_point(double x, double y, int max);
+
+// Calculate the iterations for count points of one row sharing the
+// imaginary part y. xs holds the real part of each point. stats may be NULL.
+void iterations_row(const kernel_params *params, const double *xs, double y, int count, int *iters, kernel_stats *stats);
+
+// Calculate the iterations for count arbitrary points (xs[i], ys[i])
+void iterations_points(const kernel_params *params, const double *xs, const double *ys, int count, int *iters, kernel_stats *stats);
+
+// Same as iterations_row in double-double precision (about 106 bits), for
+// zooms too deep for double. The real parts are split into xs_hi and xs_lo.
+// No shortcuts are applied.
+void iterations_row_dd(const double *xs_hi, const double *xs_lo, dd_real y, int count, int max, int *iters);
+
+// Exact sum of a double-double and a double, renormalized
+dd_real dd_add_double(dd_real a, double b);
+
+#endif  /* Compile guard */
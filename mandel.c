@@ -31,80 +31,882 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <time.h>
+#include <math.h>
 #include "jpegrw.h"
+#include "kernel.h"
+#include "bigfloat.h"
+#include "render.h"
+#include "pool.h"
+#include "worksteal.h"
+#include "encoder.h"
+#include "stream.h"
+#include "palette.h"
+#include "itermap.h"
+#include "imgpool.h"
+#include <poll.h>
 #include <fcntl.h>  // for O_CREAT
 #include <pthread.h>
+#include <stdatomic.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 
 #define NUM_FRAMES 50
 #define MAX_ITER 1000
+#define TILE_SIZE 64
+#define PROBE_SIZE 32
+#define ENCODE_QUEUE_DEPTH 2
+#define STILL_WINDOW 2  // bands each -S thread may be ahead of the encoder
 
 // Prototypes
-static int iteration_to_color(int i, int max);
-static int iterations_at_point(double x, double y, int max);
 static void show_help();
 
+// Settings that are the same for every frame of the movie
 typedef struct {
-    imgRawImage *img;
-    double xmin, xmax, ymin, ymax;
+    double xcenter, ycenter;
+    bigfloat xcenter_bf, ycenter_bf;  // exact centers for the perturbation engine
+    engine_type engine;
+    int use_series;
+    renderer_type renderer;
+    int write_previews;
+    double xscale;
+    int image_width, image_height;
     int max;
-    int start_row, end_row;
+    int tile_size;
+    const char *output_filename;
+    const double *estimates;  // probe cost estimate per frame, or NULL
+    encoder *encoder;         // writes finished frames in the background, or NULL to write them in place
+    int strip_threads;        // threads encoding strips of one JPEG
+    frame_stream *stream;     // video stream the frames go to instead of JPEG files, or NULL
+    int map_bytes;            // bytes per count of the iteration map written with each frame, 0 for none
+    const palette *palette;   // colors every frame; PALETTE_HIST frames build their own
+    int use_symmetry;         // copy rows mirrored across the real axis instead of computing them (bands)
+    int counts_only;          // keyframes: keep the counts for resampling and make no image
+    image_pool *images;       // image buffers of finished frames, for the next ones
+} MovieSettings;
+
+typedef struct {
+    imgRawImage *img;
+    const char *outfile;
+    const palette *palette;
+} PreviewData;
+
+typedef struct Frame Frame;
+
+// One tile of a frame as a work-stealing task
+typedef struct {
+    ws_task task;
+    Frame *frame;
+    int tile;
+} TileTask;
+
+// One frame in progress, shared by every thread working on it
+struct Frame {
+    const MovieSettings *settings;
+    int frame;
+    char outfile[300];
+    imgRawImage *img;
+    frame_view view;
+    int *iters;      // whole-frame iteration counts (Mariani-Silver, refinement and maps)
+    int *mirror;     // per row: the row it is copied from, or -1 to compute it (bands only)
+    ms_state *ms;
+    refine_state *rf;
+    PreviewData preview;
+    int tiles_across, num_tiles;
+    atomic_int next_tile;         // next tile to claim (thread pool)
+    atomic_int tiles_left;        // tiles not finished yet (work stealing)
+    kernel_stats *worker_stats;   // one per worker (work stealing)
+    int *tile_counts;             // tile_size^2 counts per worker for tiles without iters (work stealing)
+    ws_task task;                 // sets the frame up and spawns the tiles (work stealing)
+    TileTask *tile_tasks;
+    double started;
+};
+
+typedef struct {
+    Frame *frame;
     int thread_id;
+    int tiles;
+    double busy;     // seconds spent working on the frame
+    kernel_stats stats;
 } ThreadData;
 
-void *compute_image_part(void *arg) {
-    ThreadData *data = (ThreadData *)arg;
-    imgRawImage *img = data->img;
+static double seconds_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Write the coarse frame a refinement pass left behind as <outfile>_pass<n>.jpg.
+// The threads color the whole image again once the frame is done.
+static void write_preview(void *ctx, int pass, int step, const int *iters) {
+    PreviewData *preview = (PreviewData *)ctx;
+    imgRawImage *img = preview->img;
     int width = img->width;
+    char preview_outfile[300];
+    int len = (int)strlen(preview->outfile);
 
-    printf("Thread %d started: handling rows from %d to %d\n", data->thread_id, data->start_row, data->end_row);
+    if (len > 4 && strcmp(preview->outfile + len - 4, ".jpg") == 0) {
+        len -= 4;
+    }
+    snprintf(preview_outfile, sizeof(preview_outfile), "%.*s_pass%d.jpg", len, preview->outfile, pass + 1);
 
-    for (int j = data->start_row; j < data->end_row; j++) {
-        for (int i = 0; i < width; i++) {
-            double x = data->xmin + i * (data->xmax - data->xmin) / width;
-            double y = data->ymin + j * (data->ymax - data->ymin) / img->height;
-            int iters = iterations_at_point(x, y, data->max);
-            setPixelCOLOR(img, i, j, iteration_to_color(iters, data->max));
+    // Rows between grid rows repeat the colors of the one below them
+    unsigned int *colors = malloc(width * sizeof(unsigned int));
+    if (colors == NULL) {
+        return;
+    }
+    for (int j = 0; j < img->height; j++) {
+        if (j % step == 0) {
+            const int *row = iters + (size_t)j * width;
+            for (int i = 0; i < width; i++) {
+                colors[i] = preview->palette->colors[row[i - i % step]];
+            }
         }
+        writeSpanCOLOR(img, 0, j, width, colors);
     }
+    free(colors);
+    storeJpegImageFile(img, preview_outfile);
+}
 
-    printf("Thread %d finished: handled rows from %d to %d\n", data->thread_id, data->start_row, data->end_row);
-    return NULL;
+static double frame_scale(const MovieSettings *settings, int frame) {
+    return settings->xscale / (1 + frame * 0.1);
 }
 
-// Function to generate a single Mandelbrot frame and save it as a JPEG image
-void generate_mandel_frame(double x, double y, double scale, const char *outfile, int image_width, int image_height, int max, int num_threads) {
-    imgRawImage *img = initRawImage(image_width, image_height);
-    setImageCOLOR(img, 0);
+// Describe the reference orbit of a view that is rendered for output
+static void print_reference(const frame_view *view) {
+    if (view->ref) {
+        printf("Perturbation: %d-bit reference orbit of %d iterations, series approximation skips %d\n",
+               32 * (view->ref->limbs - 1), view->ref->length - 2, view->ref->skip);
+    }
+}
+
+// Set up frame number frame (from 0) for num_threads threads. The Frame must
+// stay where it is until frame_end.
+static void frame_begin(Frame *f, const MovieSettings *settings, int frame, int num_threads) {
+    int width = settings->image_width;
+    int height = settings->image_height;
+    double scale = frame_scale(settings, frame);
+
+    f->settings = settings;
+    f->frame = frame;
+    snprintf(f->outfile, sizeof(f->outfile), "%s_%d.jpg", settings->output_filename, frame + 1);
+
+    // Every renderer writes every pixel, so a reused image is not cleared
+    f->img = NULL;
+    if (!settings->counts_only) {
+        f->img = image_pool_get(settings->images, width, height);
+    }
+
+    if (frame_view_init(&f->view, settings->xcenter, settings->ycenter, &settings->xcenter_bf, &settings->ycenter_bf,
+                        settings->engine, settings->use_series, scale, width, height, settings->max) != 0) {
+        fprintf(stderr, "Failed to set up the frame\n");
+        exit(1);
+    }
+    print_reference(&f->view);
+
+    f->iters = NULL;
+    f->ms = NULL;
+    f->rf = NULL;
+    f->preview = (PreviewData){ f->img, f->outfile, settings->palette };
+    if (settings->renderer != RENDER_BANDS || settings->map_bytes || settings->palette->type == PALETTE_HIST ||
+        settings->counts_only) {
+        f->iters = malloc((size_t)width * height * sizeof(int));
+        if (f->iters && settings->renderer == RENDER_MARIANI_SILVER) {
+            f->ms = ms_create(&f->view, f->iters);
+        } else if (f->iters && settings->renderer == RENDER_REFINE) {
+            f->rf = refine_create(&f->view, f->iters, num_threads, settings->write_previews ? write_preview : NULL, &f->preview);
+        }
+        if (f->iters == NULL || (settings->renderer != RENDER_BANDS && f->ms == NULL && f->rf == NULL)) {
+            fprintf(stderr, "Failed to allocate the iteration buffer\n");
+            exit(1);
+        }
+    }
+
+    // Rows above the real axis whose mirror image below it is in the frame
+    // too are copied from it in frame_end
+    f->mirror = NULL;
+    if (settings->renderer == RENDER_BANDS && settings->use_symmetry) {
+        int mirrored = 0;
+        f->mirror = malloc(height * sizeof(int));
+        if (f->mirror == NULL) {
+            fprintf(stderr, "Failed to allocate the mirror table\n");
+            exit(1);
+        }
+        for (int j = 0; j < height; j++) {
+            int m = view_mirror_row(&f->view, j);
+            f->mirror[j] = m < j ? m : -1;
+            mirrored += f->mirror[j] >= 0;
+        }
+        if (mirrored == 0) {
+            free(f->mirror);
+            f->mirror = NULL;
+        }
+    }
+
+    f->tiles_across = (width + settings->tile_size - 1) / settings->tile_size;
+    f->num_tiles = f->tiles_across * ((height + settings->tile_size - 1) / settings->tile_size);
+    atomic_init(&f->next_tile, 0);
+    atomic_init(&f->tiles_left, f->num_tiles);
+    f->worker_stats = NULL;
+}
+
+// Color count pixels of row j from column x
+static void colorize_span(const palette *pal, const int *iters, imgRawImage *img, int x, int j, int count) {
+    unsigned int n = count;
+    unsigned char *rgb = getSpanRGB(img, x, j, &n);
+    if (rgb) {
+        palette_colorize(pal, iters, n, rgb);
+    }
+}
+
+// Compute (or, after Mariani-Silver and refinement, look up) the counts of
+// one tile, then color it in a separate pass, so the branchy kernels and
+// the table lookups each run over the whole tile on their own.
+// Histogram-equalized frames are colored in frame_end instead, once every
+// count is known, and keyframes are not colored at all. Frames without a
+// counts buffer keep the tile's counts in the caller's scratch, which holds
+// tile_size*tile_size counts.
+static void frame_tile(Frame *f, int tile, int *scratch, kernel_stats *stats) {
+    imgRawImage *img = f->img;
+    int width = f->view.width;
+    int height = f->view.height;
+    int tile_size = f->settings->tile_size;
+    int x0 = tile % f->tiles_across * tile_size;
+    int y0 = tile / f->tiles_across * tile_size;
+    int x1 = x0 + tile_size < width ? x0 + tile_size : width;
+    int y1 = y0 + tile_size < height ? y0 + tile_size : height;
+    const palette *pal = f->settings->palette;
+
+    // The tile's counts go in the frame's buffer if it has one
+    int *counts = f->iters ? f->iters + (size_t)y0 * width + x0 : scratch;
+    size_t stride = f->iters ? (size_t)width : (size_t)tile_size;
+
+    for (int j = y0; j < y1; j++) {
+        if (f->mirror && f->mirror[j] >= 0) {
+            stats->filled += x1 - x0;
+        } else if (f->settings->renderer == RENDER_BANDS) {
+            view_span(&f->view, j, x0, x1 - x0, counts + (j - y0) * stride, stats);
+        }
+    }
+
+    if (img && pal->type != PALETTE_HIST) {
+        for (int j = y0; j < y1; j++) {
+            if (f->mirror == NULL || f->mirror[j] < 0) {
+                colorize_span(pal, counts + (j - y0) * stride, img, x0, j, x1 - x0);
+            }
+        }
+    }
+}
+
+// Color the whole frame with a palette equalized over its own counts
+static void color_equalized(const MovieSettings *settings, const int *iters, imgRawImage *img) {
+    size_t num_pixels = (size_t)settings->image_width * settings->image_height;
+    size_t *histogram = calloc((size_t)settings->max + 1, sizeof(size_t));
+    palette *pal = palette_create(PALETTE_HIST, settings->max);
+    if (histogram == NULL || pal == NULL) {
+        fprintf(stderr, "Failed to allocate the frame palette\n");
+        exit(1);
+    }
+
+    for (size_t k = 0; k < num_pixels; k++) {
+        histogram[iters[k]]++;
+    }
+    palette_equalize(pal, histogram);
+
+    for (int j = 0; j < settings->image_height; j++) {
+        colorize_span(pal, iters + (size_t)j * settings->image_width, img, 0, j, settings->image_width);
+    }
+
+    palette_free(pal);
+    free(histogram);
+}
+
+// Copy the counts and colors of every mirrored row from its mirror image
+static void copy_mirrored_rows(Frame *f) {
+    imgRawImage *img = f->img;
+    int width = f->view.width;
+    int height = f->view.height;
+
+    for (int j = 0; j < height; j++) {
+        int m = f->mirror[j];
+        if (m < 0) {
+            continue;
+        }
+        if (f->iters) {
+            memcpy(f->iters + (size_t)j * width, f->iters + (size_t)m * width, width * sizeof(int));
+        }
+        if (img) {
+            blitImage(img, 0, j, img, 0, m, width, 1);
+        }
+    }
+}
+
+// Write the map of a finished frame if asked to, finish coloring it, and
+// save it (or hand it to the encoder threads). Takes ownership of img.
+static void output_frame(const MovieSettings *settings, int frame, const int *iters, imgRawImage *img, const char *outfile) {
+    if (settings->map_bytes) {
+        char mapfile[300];
+        snprintf(mapfile, sizeof(mapfile), "%s_%d.map", settings->output_filename, frame + 1);
+        if (itermap_write(mapfile, iters, settings->image_width, settings->image_height,
+                          settings->max, settings->map_bytes) != 0) {
+            fprintf(stderr, "Failed to write %s\n", mapfile);
+        }
+    }
+    if (settings->palette->type == PALETTE_HIST) {
+        color_equalized(settings, iters, img);
+    }
+
+    if (settings->stream) {
+        stream_put(settings->stream, frame, img);
+    } else if (settings->encoder) {
+        encoder_submit(settings->encoder, img, outfile);
+    } else {
+        storeJpegImageFileParallel(img, outfile, settings->strip_threads);
+        image_pool_put(settings->images, img);
+    }
+}
+
+// Output the frame and free everything frame_begin set up. A counts_only
+// frame is not output; its counts are returned instead, for the caller to
+// free. Returns NULL otherwise.
+static int *frame_end(Frame *f) {
+    const MovieSettings *settings = f->settings;
+    int *counts = NULL;
+
+    if (f->mirror) {
+        copy_mirrored_rows(f);
+        free(f->mirror);
+    }
+    if (settings->counts_only) {
+        counts = f->iters;
+        f->iters = NULL;
+    } else {
+        output_frame(settings, f->frame, f->iters, f->img, f->outfile);
+    }
+
+    if (f->ms) {
+        ms_free(f->ms);
+    }
+    if (f->rf) {
+        refine_free(f->rf);
+    }
+    free(f->iters);
+    frame_view_free(&f->view);
+    return counts;
+}
+
+// seconds is how long the frame took to render
+static void print_frame_stats(const MovieSettings *settings, int frame, const kernel_stats *stats, double seconds) {
+    int kernel_options = kernel_get_options();
+
+    if (settings->estimates) {
+        printf("Frame %d: estimated %.4g iterations, took %.3f seconds\n", frame + 1, settings->estimates[frame], seconds);
+    }
+    if (kernel_options & KERNEL_OPT_BULB_CHECK) {
+        printf("Frame %d: cardioid test caught %lu pixels, bulb test caught %lu pixels\n", frame + 1, stats->cardioid, stats->bulb);
+    }
+    if (kernel_options & KERNEL_OPT_PERIODICITY) {
+        printf("Frame %d: cycle detection caught %lu pixels\n", frame + 1, stats->periodic);
+    }
+    if (stats->rebased) {
+        printf("Frame %d: %lu perturbation rebases\n", frame + 1, stats->rebased);
+    }
+    if (stats->filled) {
+        printf("Frame %d: renderer filled %lu pixels without the kernel\n", frame + 1, stats->filled);
+    }
+    if (stats->skipped) {
+        printf("Frame %d: series approximation skipped %lu iterations\n", frame + 1, stats->skipped);
+    }
+    if (kernel_options & KERNEL_OPT_VALIDATE) {
+        printf("Frame %d: %lu of %lu pixels differ from the plain kernel\n", frame + 1, stats->mismatched, stats->validated);
+    }
+}
+
+static void compute_image_part(void *arg) {
+    ThreadData *data = (ThreadData *)arg;
+    Frame *f = data->frame;
+    double start = seconds_now();
+
+    printf("Thread %d started\n", data->thread_id);
 
-    pthread_t threads[num_threads];
+    // Mariani-Silver and refinement threads share the whole frame first,
+    // and the tiles only color what they found
+    if (f->ms) {
+        ms_run(f->ms, &data->stats);
+    } else if (f->rf) {
+        refine_run(f->rf, data->thread_id, &data->stats);
+    }
+
+    int tile_size = f->settings->tile_size;
+    int *scratch = f->iters ? NULL : malloc((size_t)tile_size * tile_size * sizeof(int));
+    if (f->iters == NULL && scratch == NULL) {
+        fprintf(stderr, "Failed to allocate the tile buffer\n");
+        exit(1);
+    }
+
+    // Claim tiles until none are left, so a thread that drew cheap tiles
+    // takes more instead of waiting for the ones covering the set
+    for (int tile = atomic_fetch_add(&f->next_tile, 1); tile < f->num_tiles; tile = atomic_fetch_add(&f->next_tile, 1)) {
+        frame_tile(f, tile, scratch, &data->stats);
+        data->tiles++;
+    }
+    free(scratch);
+
+    data->busy = seconds_now() - start;
+
+    printf("Thread %d finished: handled %d tiles\n", data->thread_id, data->tiles);
+}
+
+// Function to generate a single Mandelbrot frame and save it as a JPEG image
+// Render on every worker of pool. busy[t] accumulates the time worker t spent working.
+// Returns the counts of a counts_only frame (see frame_end).
+int *generate_mandel_frame(const MovieSettings *settings, int frame, thread_pool *pool, kernel_stats *stats, double *busy) {
+    int num_threads = pool_size(pool);
     ThreadData thread_data[num_threads];
-    int rows_per_thread = image_height / num_threads;
-    int remaining_rows = image_height % num_threads;
+    Frame f;
+
+    frame_begin(&f, settings, frame, num_threads);
 
     for (int t = 0; t < num_threads; t++) {
-        thread_data[t].img = img;
-        thread_data[t].xmin = x - scale / 2;
-        thread_data[t].xmax = x + scale / 2;
-        thread_data[t].ymin = y - scale / 2;
-        thread_data[t].ymax = y + scale / 2;
-        thread_data[t].max = max;
-        thread_data[t].start_row = t * rows_per_thread;
-        thread_data[t].end_row = (t == num_threads - 1) ? (thread_data[t].start_row + rows_per_thread + remaining_rows) : (thread_data[t].start_row + rows_per_thread);
+        thread_data[t].frame = &f;
         thread_data[t].thread_id = t;
+        thread_data[t].tiles = 0;
+        memset(&thread_data[t].stats, 0, sizeof(kernel_stats));
+
+        // One job per worker: the refinement barrier needs all of them running at once
+        pool_submit(pool, compute_image_part, &thread_data[t]);
+    }
+
+    pool_wait(pool);
+    for (int t = 0; t < num_threads; t++) {
+        kernel_stats_add(stats, &thread_data[t].stats);
+        busy[t] += thread_data[t].busy;
+    }
+
+    return frame_end(&f);
+}
+
+static void tile_task(worksteal *ws, int worker, void *arg) {
+    TileTask *t = (TileTask *)arg;
+    Frame *f = t->frame;
+
+    int tile_area = f->settings->tile_size * f->settings->tile_size;
+    frame_tile(f, t->tile, f->tile_counts + (size_t)worker * tile_area, &f->worker_stats[worker]);
+
+    // Whoever finishes the last tile saves the frame
+    if (atomic_fetch_sub(&f->tiles_left, 1) == 1) {
+        kernel_stats stats = {0};
+        for (int w = 0; w < ws_workers(ws); w++) {
+            kernel_stats_add(&stats, &f->worker_stats[w]);
+        }
+        frame_end(f);
+        printf("Worker %d generated frame %d\n", worker, f->frame + 1);
+        print_frame_stats(f->settings, f->frame, &stats, seconds_now() - f->started);
+        free(f->worker_stats);
+        free(f->tile_tasks);
+    }
+}
+
+// Set a frame up and spawn its tiles. Mariani-Silver and refinement frames
+// run their renderer here on one worker, since it waits for its own
+// threads and those cannot be held back from stealing.
+static void frame_task(worksteal *ws, int worker, void *arg) {
+    Frame *f = (Frame *)arg;
+
+    f->started = seconds_now();
+    frame_begin(f, f->settings, f->frame, 1);
+    f->worker_stats = calloc(ws_workers(ws), sizeof(kernel_stats));
+    f->tile_tasks = malloc(f->num_tiles * sizeof(TileTask));
+    if (f->worker_stats == NULL || f->tile_tasks == NULL) {
+        fprintf(stderr, "Failed to allocate the tiles of frame %d\n", f->frame + 1);
+        exit(1);
+    }
+
+    if (f->ms) {
+        ms_run(f->ms, &f->worker_stats[worker]);
+    } else if (f->rf) {
+        refine_run(f->rf, 0, &f->worker_stats[worker]);
+    }
+
+    for (int t = 0; t < f->num_tiles; t++) {
+        TileTask *tile = &f->tile_tasks[t];
+        *tile = (TileTask){ { tile_task, tile }, f, t };
+        ws_spawn(ws, worker, &tile->task);
+    }
+}
+
+// Estimate the cost of every frame from the iteration counts of a
+// probe_size square render of it, scaled up to the full frame
+static void probe_frame_costs(const MovieSettings *settings, int probe_size, double *costs) {
+    int *iters = malloc(probe_size * sizeof(int));
+    double scale_up = (double)settings->image_width * settings->image_height / ((double)probe_size * probe_size);
+
+    for (int frame = 0; frame < NUM_FRAMES; frame++) {
+        frame_view view;
+        kernel_stats stats = {0};
+        double total = 0;
+
+        if (iters == NULL ||
+            frame_view_init(&view, settings->xcenter, settings->ycenter, &settings->xcenter_bf, &settings->ycenter_bf, settings->engine,
+                            settings->use_series, frame_scale(settings, frame), probe_size, probe_size, settings->max) != 0) {
+            fprintf(stderr, "Failed to set up the probe of frame %d\n", frame + 1);
+            exit(1);
+        }
+        for (int j = 0; j < probe_size; j++) {
+            view_span(&view, j, 0, probe_size, iters, &stats);
+            for (int i = 0; i < probe_size; i++) {
+                total += iters[i];
+            }
+        }
+        // The cardioid and bulb checks answer without iterating
+        total -= (double)(stats.cardioid + stats.bulb) * settings->max;
+        costs[frame] = total * scale_up;
+        frame_view_free(&view);
+    }
+
+    free(iters);
+}
+
+// Sort the frames by falling cost so the longest are handed out first.
+// Ties go to the deeper frame.
+static void order_frames(const double *costs, int *order) {
+    for (int k = 0; k < NUM_FRAMES; k++) {
+        int frame = NUM_FRAMES - 1 - k;
+        int pos = k;
+        while (pos > 0 && costs[order[pos - 1]] < costs[frame]) {
+            order[pos] = order[pos - 1];
+            pos--;
+        }
+        order[pos] = frame;
+    }
+}
+
+// Render the whole movie in this process on num_workers work-stealing
+// workers. order lists the frames by falling cost.
+static void run_work_stealing(const MovieSettings *settings, int num_workers, const int *order, const double *costs) {
+    worksteal *ws = ws_create(num_workers);
+    Frame *frames = malloc(NUM_FRAMES * sizeof(Frame));
+    int *tile_counts = malloc((size_t)num_workers * settings->tile_size * settings->tile_size * sizeof(int));
+    double load[num_workers];
+    int worker_of[NUM_FRAMES];
+    if (ws == NULL || frames == NULL || tile_counts == NULL) {
+        fprintf(stderr, "Failed to set up %d workers\n", num_workers);
+        exit(1);
+    }
+
+    // Longest processing time first: each frame goes to the worker with the
+    // least work so far. Stealing evens out whatever the estimate got wrong.
+    memset(load, 0, sizeof(load));
+    for (int k = 0; k < NUM_FRAMES; k++) {
+        int best = 0;
+        for (int w = 1; w < num_workers; w++) {
+            if (load[w] < load[best]) {
+                best = w;
+            }
+        }
+        worker_of[k] = best;
+        load[best] += costs[order[k]];
+    }
+
+    // Each worker runs its newest task first, so they are pushed in reverse
+    for (int k = NUM_FRAMES - 1; k >= 0; k--) {
+        Frame *f = &frames[order[k]];
+        f->settings = settings;
+        f->frame = order[k];
+        f->tile_counts = tile_counts;
+        f->task = (ws_task){ frame_task, f };
+        ws_submit(ws, worker_of[k], &f->task);
+    }
+
+    if (ws_run(ws) != 0) {
+        fprintf(stderr, "Failed to start %d workers\n", num_workers);
+        exit(1);
+    }
+    for (int w = 0; w < num_workers; w++) {
+        printf("Worker %d: busy for %.3f seconds\n", w, ws_busy(ws, w));
+    }
+
+    ws_free(ws);
+    free(frames);
+    free(tile_counts);
+}
+
+// Index of the keyframe sample nearest to each of count pixels of a frame
+// ratio times the keyframe's scale, with the same center. Keyframes are
+// quality times the frame size. Pixels the keyframe does not reach get -1.
+static void keyframe_samples(int count, int quality, double ratio, int *samples) {
+    for (int i = 0; i < count; i++) {
+        double u = quality * (i - count / 2.0) * ratio + quality * count / 2.0;
+        int k = (int)floor(u + 0.5);
+        samples[i] = k >= 0 && k < quality * count ? k : -1;
+    }
+}
+
+// Make frame from the counts of keyframe k0 at or before it (outer) and
+// keyframe k1 after it (inner, NULL if there is none) and output it.
+// Every pixel takes the nearest keyframe sample: from the inner keyframe
+// where it reaches, as it is the sharper of the two there, and from the
+// outer one elsewhere, which covers the whole frame.
+static void resample_frame(const MovieSettings *settings, int frame, int quality, const int *outer, int k0,
+                           const int *inner, int k1) {
+    int width = settings->image_width;
+    int height = settings->image_height;
+    int key_width = quality * width;
+    int cols[2][width], rows[2][height];
+    double scale = frame_scale(settings, frame);
+
+    keyframe_samples(width, quality, scale / frame_scale(settings, k0), cols[0]);
+    keyframe_samples(height, quality, scale / frame_scale(settings, k0), rows[0]);
+    if (inner && frame != k0) {
+        keyframe_samples(width, quality, scale / frame_scale(settings, k1), cols[1]);
+        keyframe_samples(height, quality, scale / frame_scale(settings, k1), rows[1]);
+    } else {
+        memset(cols[1], 0xFF, sizeof(cols[1]));
+        memset(rows[1], 0xFF, sizeof(rows[1]));
+    }
+
+    int *iters = malloc((size_t)width * height * sizeof(int));
+    imgRawImage *img = image_pool_get(settings->images, width, height);
+    if (iters == NULL) {
+        fprintf(stderr, "Failed to allocate the iteration buffer\n");
+        exit(1);
+    }
+    const palette *pal = settings->palette;
+    for (int j = 0; j < height; j++) {
+        int *row = iters + (size_t)j * width;
+        for (int i = 0; i < width; i++) {
+            if (rows[1][j] >= 0 && cols[1][i] >= 0) {
+                row[i] = inner[(size_t)rows[1][j] * key_width + cols[1][i]];
+            } else {
+                row[i] = outer[(size_t)rows[0][j] * key_width + cols[0][i]];
+            }
+        }
+        if (pal->type != PALETTE_HIST) {
+            colorize_span(pal, row, img, 0, j, width);
+        }
+    }
+
+    char outfile[300];
+    snprintf(outfile, sizeof(outfile), "%s_%d.jpg", settings->output_filename, frame + 1);
+    output_frame(settings, frame, iters, img, outfile);
+    free(iters);
+}
+
+// Render keyframe number frame at quality times the frame size on every
+// worker of pool and return its counts
+static int *render_keyframe(const MovieSettings *key, int frame, thread_pool *pool, double *busy) {
+    kernel_stats stats = {0};
+    double started = seconds_now();
+    int *counts = generate_mandel_frame(key, frame, pool, &stats, busy);
 
-        if (pthread_create(&threads[t], NULL, compute_image_part, &thread_data[t]) != 0) {
-            perror("Failed to create thread");
+    printf("Rendered keyframe %d at %dx%d\n", frame + 1, key->image_width, key->image_height);
+    print_frame_stats(key, frame, &stats, seconds_now() - started);
+    return counts;
+}
+
+// Render every interval-th frame (and the last one) as a keyframe quality
+// times the frame size, on num_threads threads, and make every frame from
+// the keyframes around it instead of computing it. Frames come out in order.
+static void run_keyframes(const MovieSettings *settings, int num_threads, int interval, int quality) {
+    MovieSettings key = *settings;
+    key.image_width *= quality;
+    key.image_height *= quality;
+    key.counts_only = 1;
+    key.write_previews = 0;
+    key.map_bytes = 0;
+    key.estimates = NULL;
+
+    thread_pool *pool = pool_create(num_threads);
+    if (pool == NULL) {
+        fprintf(stderr, "Failed to start %d threads\n", num_threads);
+        exit(1);
+    }
+    double busy[num_threads];
+    memset(busy, 0, sizeof(busy));
+
+    int k0 = 0;
+    int *outer = render_keyframe(&key, k0, pool, busy);
+    while (k0 < NUM_FRAMES - 1) {
+        int k1 = k0 + interval < NUM_FRAMES - 1 ? k0 + interval : NUM_FRAMES - 1;
+        int *inner = render_keyframe(&key, k1, pool, busy);
+        for (int frame = k0; frame < k1; frame++) {
+            resample_frame(settings, frame, quality, outer, k0, inner, k1);
+            printf("Resampled frame %d from keyframes %d and %d\n", frame + 1, k0 + 1, k1 + 1);
+        }
+        free(outer);
+        outer = inner;
+        k0 = k1;
+    }
+    resample_frame(settings, k0, quality, outer, k0, NULL, 0);
+    printf("Resampled frame %d from keyframe %d\n", k0 + 1, k0 + 1);
+    free(outer);
+
+    pool_destroy(pool);
+    for (int t = 0; t < num_threads; t++) {
+        printf("Thread %d: busy for %.3f seconds\n", t, busy[t]);
+    }
+}
+
+// A still rendered in bands of rows that go to the JPEG encoder in order,
+// so only a window of bands is ever in memory
+typedef struct {
+    const MovieSettings *settings;
+    frame_view view;
+    int band_rows, num_bands;
+    int window;                 // bands in memory at once
+    unsigned char **slots;      // band b is colored into slots[b % window]
+    int *finished;              // per slot: the band finished in it, or -1
+    int next_band;              // next band to claim
+    int written;                // bands the encoder has taken so far
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    kernel_stats stats;
+} Still;
+
+// Claim bands in order and color them, staying less than a window ahead
+// of the encoder
+static void still_worker(void *arg) {
+    Still *st = (Still *)arg;
+    int width = st->view.width;
+    int height = st->view.height;
+    int *iters = malloc(width * sizeof(int));
+    kernel_stats stats = {0};
+    if (iters == NULL) {
+        fprintf(stderr, "Failed to allocate the iteration buffer\n");
+        exit(1);
+    }
+
+    pthread_mutex_lock(&st->lock);
+    while (st->next_band < st->num_bands) {
+        if (st->next_band >= st->written + st->window) {
+            pthread_cond_wait(&st->changed, &st->lock);
+            continue;
+        }
+        int band = st->next_band++;
+        pthread_mutex_unlock(&st->lock);
+
+        unsigned char *rgb = st->slots[band % st->window];
+        int top = band * st->band_rows;
+        int rows = top + st->band_rows < height ? st->band_rows : height - top;
+        for (int k = 0; k < rows; k++) {
+            // Bands run top down; view rows count from the bottom
+            view_span(&st->view, height - 1 - (top + k), 0, width, iters, &stats);
+            palette_colorize(st->settings->palette, iters, width, rgb + (size_t)k * width * 3);
+        }
+
+        pthread_mutex_lock(&st->lock);
+        st->finished[band % st->window] = band;
+        pthread_cond_broadcast(&st->changed);
+    }
+    kernel_stats_add(&st->stats, &stats);
+    pthread_mutex_unlock(&st->lock);
+    free(iters);
+}
+
+// Render the first frame's view as one image into <output>.jpg, band_rows
+// rows at a time on num_threads threads, while this thread encodes the
+// finished bands in order. Memory grows with the width, not the height.
+static void render_still(const MovieSettings *settings, int num_threads, int band_rows) {
+    int width = settings->image_width;
+    int height = settings->image_height;
+    char outfile[300];
+
+    // A band taller than the image would only make the slots bigger
+    if (band_rows > height) {
+        band_rows = height;
+    }
+    Still st = {
+        .settings = settings,
+        .band_rows = band_rows,
+        .num_bands = (height + band_rows - 1) / band_rows,
+        .window = STILL_WINDOW * num_threads,
+    };
+
+    if (frame_view_init(&st.view, settings->xcenter, settings->ycenter, &settings->xcenter_bf, &settings->ycenter_bf,
+                        settings->engine, settings->use_series, frame_scale(settings, 0), width, height, settings->max) != 0) {
+        fprintf(stderr, "Failed to set up the image\n");
+        exit(1);
+    }
+    print_reference(&st.view);
+    snprintf(outfile, sizeof(outfile), "%s.jpg", settings->output_filename);
+    jpegWriter *writer = openJpegWriter(outfile, width, height);
+    st.slots = calloc(st.window, sizeof(unsigned char *));
+    st.finished = malloc(st.window * sizeof(int));
+    thread_pool *pool = pool_create(num_threads);
+    if (writer == NULL || st.slots == NULL || st.finished == NULL || pool == NULL) {
+        fprintf(stderr, "Failed to set up %s\n", outfile);
+        exit(1);
+    }
+    for (int k = 0; k < st.window; k++) {
+        st.slots[k] = malloc((size_t)band_rows * width * 3);
+        st.finished[k] = -1;
+        if (st.slots[k] == NULL) {
+            fprintf(stderr, "Failed to allocate %d bands of %d rows\n", st.window, band_rows);
             exit(1);
         }
     }
+    pthread_mutex_init(&st.lock, NULL);
+    pthread_cond_init(&st.changed, NULL);
 
+    double started = seconds_now();
     for (int t = 0; t < num_threads; t++) {
-        pthread_join(threads[t], NULL);
+        pool_submit(pool, still_worker, &st);
     }
+    for (int band = 0; band < st.num_bands; band++) {
+        pthread_mutex_lock(&st.lock);
+        while (st.finished[band % st.window] != band) {
+            pthread_cond_wait(&st.changed, &st.lock);
+        }
+        pthread_mutex_unlock(&st.lock);
+
+        int top = band * band_rows;
+        writeJpegRows(writer, st.slots[band % st.window], top + band_rows < height ? band_rows : height - top);
 
-    storeJpegImageFile(img, outfile);
-    freeRawImage(img);
+        pthread_mutex_lock(&st.lock);
+        st.written++;
+        pthread_cond_broadcast(&st.changed);
+        pthread_mutex_unlock(&st.lock);
+    }
+    pool_wait(pool);
+    pool_destroy(pool);
+
+    if (closeJpegWriter(writer) != 0) {
+        fprintf(stderr, "Failed to write %s\n", outfile);
+        exit(1);
+    }
+    printf("Wrote %dx%d still %s in %d bands of %d rows in %.3f seconds\n", width, height, outfile, st.num_bands, band_rows,
+           seconds_now() - started);
+    print_frame_stats(settings, 0, &st.stats, seconds_now() - started);
+
+    pthread_mutex_destroy(&st.lock);
+    pthread_cond_destroy(&st.changed);
+    for (int k = 0; k < st.window; k++) {
+        free(st.slots[k]);
+    }
+    free(st.slots);
+    free(st.finished);
+    frame_view_free(&st.view);
+}
+
+// Start the encoder threads, or return NULL to encode in place when there are none
+static encoder *start_encoder(int nthreads, int depth, int strip_threads, image_pool *images) {
+    if (nthreads == 0) {
+        return NULL;
+    }
+    encoder *enc = encoder_create(nthreads, depth, strip_threads, images);
+    if (enc == NULL) {
+        fprintf(stderr, "Failed to start %d encoder threads\n", nthreads);
+        exit(1);
+    }
+    return enc;
+}
+
+static frame_stream *open_stream(int fd, stream_format format, int width, int height, image_pool *images) {
+    frame_stream *stream = stream_create(fd, format, width, height, NUM_FRAMES, images);
+    if (stream == NULL) {
+        fprintf(stderr, "Failed to set up the video stream\n");
+        exit(1);
+    }
+    return stream;
 }
 
 int main(int argc, char *argv[]) {
@@ -113,22 +915,51 @@ int main(int argc, char *argv[]) {
     // Default configuration values
     double xcenter = 0;
     double ycenter = 0;
+    const char *xcenter_str = "0"; // exact centers for the perturbation engine
+    const char *ycenter_str = "0";
+    bigfloat xcenter_bf, ycenter_bf;
+    engine_type engine = ENGINE_AUTO;
+    int use_series = 1;
+    renderer_type renderer = RENDER_BANDS;
+    int write_previews = 0;
     double xscale = 4;
     int image_width = 1000;
     int image_height = 1000;
     int max = 1000;
     int num_children = 1; // default number of children
     int num_threads = 1; // default number of threads
+    int max_concurrent = 0; // frames rendered at once, 0 for one per child
+    int workers = 0;        // work-stealing workers, 0 for children and threads
+    int split_by_hand = 0;  // -c or -t given: no work stealing
+    int children_given = 0; // -c given
+    int probe_size = PROBE_SIZE;
+    int encoder_threads = 0;
+    int queue_depth = ENCODE_QUEUE_DEPTH;
+    int strip_threads = 1;
+    int tile_size = TILE_SIZE;
+    int map_bytes = 0;
+    palette_type palette_kind = PALETTE_CLASSIC;
+    int use_symmetry = 1;
+    int keyframe_interval = 0;  // -K: frames from one keyframe to the next, 0 to compute every frame
+    int keyframe_quality = 2;
+    int still_rows = 0;         // -S: rows per band of one streamed still, 0 for the movie
     char output_filename[256] = "mandel_frame"; // Default filename prefix
+    int output_given = 0;
+    int streaming = 0;      // -f y4m or rgb: one video stream instead of JPEG files
+    stream_format format = STREAM_Y4M;
+    kernel_type kernel = KERNEL_AUTO;
+    int kernel_options = KERNEL_OPT_BULB_CHECK | KERNEL_OPT_PERIODICITY;
 
     // Command line argument parsing
-    while ((c = getopt(argc, argv, "x:y:s:W:H:m:o:c:t:h")) != -1) {
+    while ((c = getopt(argc, argv, "x:y:s:W:H:m:o:f:i:P:c:t:T:j:l:z:E:q:J:k:e:r:K:Q:S:wABMNVh")) != -1) {
         switch (c) {
             case 'x':
                 xcenter = atof(optarg);
+                xcenter_str = optarg;
                 break;
             case 'y':
                 ycenter = atof(optarg);
+                ycenter_str = optarg;
                 break;
             case 's':
                 xscale = atof(optarg);
@@ -145,17 +976,170 @@ int main(int argc, char *argv[]) {
             case 'o':
                 strncpy(output_filename, optarg, sizeof(output_filename) - 1);
                 output_filename[sizeof(output_filename) - 1] = '\0'; // Ensure null-termination
+                output_given = 1;
+                break;
+            case 'f':
+                if (strcmp(optarg, "jpeg") == 0) {
+                    streaming = 0;
+                } else if (strcmp(optarg, "y4m") == 0) {
+                    streaming = 1;
+                    format = STREAM_Y4M;
+                } else if (strcmp(optarg, "rgb") == 0) {
+                    streaming = 1;
+                    format = STREAM_RGB;
+                } else {
+                    fprintf(stderr, "Invalid output format %s. Use jpeg, y4m or rgb.\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'i':
+                map_bytes = atoi(optarg) / 8;
+                if (map_bytes != 2 && map_bytes != 4) {
+                    fprintf(stderr, "Invalid iteration map width %s. Use 16 or 32.\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'P':
+                if (palette_parse(optarg) < 0) {
+                    fprintf(stderr, "Invalid palette %s. Use classic, grey, fire or hist.\n", optarg);
+                    exit(1);
+                }
+                palette_kind = palette_parse(optarg);
                 break;
             case 'c':
                 num_children = atoi(optarg);
+                split_by_hand = 1;
+                children_given = 1;
                 break;
             case 't':
                 num_threads = atoi(optarg);
+                split_by_hand = 1;
                 if (num_threads < 1 || num_threads > 20) {
                     fprintf(stderr, "Invalid number of threads. Use 1-20.\n");
                     exit(1);
                 }
                 break;
+            case 'j':
+                workers = atoi(optarg);
+                if (workers < 1) {
+                    fprintf(stderr, "Invalid number of workers. Use 1 or more.\n");
+                    exit(1);
+                }
+                break;
+            case 'l':
+                max_concurrent = atoi(optarg);
+                if (max_concurrent < 1) {
+                    fprintf(stderr, "Invalid concurrency limit. Use 1 or more.\n");
+                    exit(1);
+                }
+                break;
+            case 'z':
+                probe_size = atoi(optarg);
+                if (probe_size < 0) {
+                    fprintf(stderr, "Invalid probe size. Use 0 to turn probes off, or more.\n");
+                    exit(1);
+                }
+                break;
+            case 'E':
+                encoder_threads = atoi(optarg);
+                if (encoder_threads < 0) {
+                    fprintf(stderr, "Invalid number of encoder threads. Use 0 to encode in place, or more.\n");
+                    exit(1);
+                }
+                break;
+            case 'q':
+                queue_depth = atoi(optarg);
+                if (queue_depth < 1) {
+                    fprintf(stderr, "Invalid encode queue depth. Use 1 or more.\n");
+                    exit(1);
+                }
+                break;
+            case 'J':
+                strip_threads = atoi(optarg);
+                if (strip_threads < 1) {
+                    fprintf(stderr, "Invalid number of JPEG strip threads. Use 1 or more.\n");
+                    exit(1);
+                }
+                break;
+            case 'T':
+                tile_size = atoi(optarg);
+                if (tile_size < 1) {
+                    fprintf(stderr, "Invalid tile size. Use 1 or more.\n");
+                    exit(1);
+                }
+                break;
+            case 'k':
+                if (kernel_parse(optarg) < 0) {
+                    fprintf(stderr, "Invalid kernel %s. Use auto, scalar, avx2 or avx512.\n", optarg);
+                    exit(1);
+                }
+                kernel = kernel_parse(optarg);
+                break;
+            case 'e':
+                if (strcmp(optarg, "auto") == 0) {
+                    engine = ENGINE_AUTO;
+                } else if (strcmp(optarg, "double") == 0) {
+                    engine = ENGINE_DOUBLE;
+                } else if (strcmp(optarg, "dd") == 0) {
+                    engine = ENGINE_DD;
+                } else if (strcmp(optarg, "perturb") == 0) {
+                    engine = ENGINE_PERTURB;
+                } else {
+                    fprintf(stderr, "Invalid engine %s. Use auto, double, dd or perturb.\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'r':
+                if (strcmp(optarg, "bands") == 0) {
+                    renderer = RENDER_BANDS;
+                } else if (strcmp(optarg, "ms") == 0) {
+                    renderer = RENDER_MARIANI_SILVER;
+                } else if (strcmp(optarg, "refine") == 0) {
+                    renderer = RENDER_REFINE;
+                } else {
+                    fprintf(stderr, "Invalid renderer %s. Use bands, ms or refine.\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'K':
+                keyframe_interval = atoi(optarg);
+                if (keyframe_interval < 0) {
+                    fprintf(stderr, "Invalid keyframe interval. Use 0 to compute every frame, or more.\n");
+                    exit(1);
+                }
+                break;
+            case 'Q':
+                keyframe_quality = atoi(optarg);
+                if (keyframe_quality < 1 || keyframe_quality > 8) {
+                    fprintf(stderr, "Invalid keyframe quality. Use 1-8.\n");
+                    exit(1);
+                }
+                break;
+            case 'S':
+                still_rows = atoi(optarg);
+                if (still_rows < 1) {
+                    fprintf(stderr, "Invalid band height. Use 1 or more rows.\n");
+                    exit(1);
+                }
+                break;
+            case 'w':
+                write_previews = 1;
+                break;
+            case 'A':
+                use_series = 0;
+                break;
+            case 'B':
+                kernel_options &= ~KERNEL_OPT_BULB_CHECK;
+                break;
+            case 'M':
+                use_symmetry = 0;
+                break;
+            case 'N':
+                kernel_options &= ~KERNEL_OPT_PERIODICITY;
+                break;
+            case 'V':
+                kernel_options |= KERNEL_OPT_VALIDATE;
+                break;
             case 'h':
                 show_help();
                 exit(1);
@@ -167,25 +1151,205 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    printf("Generating Mandel movie with %d images using %d children...\n", NUM_FRAMES, num_children);
+    if (workers > 0 && (split_by_hand || max_concurrent > 0)) {
+        fprintf(stderr, "-j runs its own workers in one process: it cannot be combined with -c, -t or -l.\n");
+        exit(1);
+    }
 
-    // Create semaphore to enforce order
-    sem_t *sem = sem_open("/mandel_semaphore", O_CREAT | O_EXCL, 0644, 1);
-    if (sem == SEM_FAILED) {
-        sem_unlink("/mandel_semaphore");
-        sem = sem_open("/mandel_semaphore", O_CREAT, 0644, 1);
-        if (sem == SEM_FAILED) {
-            perror("Semaphore creation failed");
+    if (map_bytes == 2 && max > 65535) {
+        fprintf(stderr, "A maximum of %d iterations does not fit a 16-bit iteration map. Use -i 32.\n", max);
+        exit(1);
+    }
+
+    if (still_rows && (streaming || palette_kind == PALETTE_HIST)) {
+        fprintf(stderr, "A still (-S) is written as a JPEG band by band: it cannot be streamed with -f or use the hist palette.\n");
+        exit(1);
+    }
+
+    if (still_rows && (workers > 0 || children_given || max_concurrent > 0 || renderer != RENDER_BANDS || map_bytes ||
+                       keyframe_interval > 0 || encoder_threads > 0 || strip_threads > 1)) {
+        fprintf(stderr, "A still (-S) computes its bands on the -t threads of one process and encodes them itself:\n"
+                        "it cannot be combined with -j, -c, -l, -r, -i, -K, -E or -J.\n");
+        exit(1);
+    }
+
+    if (keyframe_interval > 0 && (workers > 0 || children_given || max_concurrent > 0)) {
+        fprintf(stderr, "Keyframes (-K) are rendered on the -t threads of one process: they cannot be combined with -j, -c or -l.\n");
+        exit(1);
+    }
+
+    if (bf_from_string(&xcenter_bf, xcenter_str, BF_MAX_LIMBS) != 0 ||
+        bf_from_string(&ycenter_bf, ycenter_str, BF_MAX_LIMBS) != 0) {
+        fprintf(stderr, "Invalid center coordinate %s, %s.\n", xcenter_str, ycenter_str);
+        exit(1);
+    }
+
+    // A video stream goes to the file (or FIFO) named by -o, or to stdout
+    // for "-" and by default. The progress messages then go to stderr.
+    int stream_fd = -1;
+    if (streaming) {
+        if (!output_given || strcmp(output_filename, "-") == 0) {
+            fflush(stdout);
+            stream_fd = dup(STDOUT_FILENO);
+            dup2(STDERR_FILENO, STDOUT_FILENO);
+        } else {
+            stream_fd = open(output_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        }
+        if (stream_fd < 0) {
+            perror("Failed to open the video stream");
+            exit(1);
+        }
+    }
+
+    MovieSettings settings = {
+        .xcenter = xcenter, .ycenter = ycenter,
+        .xcenter_bf = xcenter_bf, .ycenter_bf = ycenter_bf,
+        .engine = engine, .use_series = use_series,
+        .renderer = renderer, .write_previews = write_previews,
+        .xscale = xscale,
+        .image_width = image_width, .image_height = image_height,
+        .max = max, .tile_size = tile_size,
+        .output_filename = output_filename,
+        .strip_threads = strip_threads,
+        .map_bytes = map_bytes,
+        .use_symmetry = use_symmetry,
+    };
+
+    // One table colors every frame of the run; children inherit it
+    palette *pal = palette_create(palette_kind, max);
+    if (pal == NULL) {
+        fprintf(stderr, "Failed to allocate the palette\n");
+        exit(1);
+    }
+    settings.palette = pal;
+
+    // Children inherit the pool empty and keep their own buffers in it
+    settings.images = image_pool_create();
+    if (settings.images == NULL) {
+        fprintf(stderr, "Failed to allocate the image pool\n");
+        exit(1);
+    }
+
+    // Pick the kernel before forking so every child inherits the choice
+    kernel = kernel_select(kernel);
+    kernel_set_options(kernel_options);
+
+    // -S renders one image band by band instead of the movie
+    if (still_rows > 0) {
+        printf("Generating a %dx%d still in bands of %d rows using %d threads...\n", image_width, image_height, still_rows, num_threads);
+        printf("Using %s escape-time kernel\n", kernel_name(kernel));
+        render_still(&settings, num_threads, still_rows);
+        palette_free(pal);
+        image_pool_free(settings.images);
+        return 0;
+    }
+
+    // Probe every frame at a tiny size to estimate what it costs. Without
+    // probes, deeper frames are assumed to cost more.
+    double costs[NUM_FRAMES];
+    int order[NUM_FRAMES];
+    if (probe_size > 0) {
+        probe_frame_costs(&settings, probe_size, costs);
+        settings.estimates = costs;
+    } else {
+        for (int frame = 0; frame < NUM_FRAMES; frame++) {
+            costs[frame] = frame;
+        }
+    }
+    order_frames(costs, order);
+
+    // A stream can only write frames in order, so render them in order and
+    // keep the reorder buffer down to the frames in flight
+    if (streaming) {
+        for (int frame = 0; frame < NUM_FRAMES; frame++) {
+            order[frame] = frame;
+        }
+    }
+
+    // -K renders keyframes on the -t threads of this process and resamples
+    // every frame from them
+    if (keyframe_interval > 0) {
+        printf("Generating Mandel movie with %d images from keyframes every %d frames at %dx, using %d threads...\n",
+               NUM_FRAMES, keyframe_interval, keyframe_quality, num_threads);
+        printf("Using %s escape-time kernel\n", kernel_name(kernel));
+        settings.encoder = start_encoder(encoder_threads, queue_depth, strip_threads, settings.images);
+        settings.stream = streaming ? open_stream(stream_fd, format, image_width, image_height, settings.images) : NULL;
+        run_keyframes(&settings, num_threads, keyframe_interval, keyframe_quality);
+        if (settings.encoder) {
+            encoder_finish(settings.encoder);
+        }
+        if (settings.stream && (stream_close(settings.stream) != 0 || close(stream_fd) != 0)) {
             exit(1);
         }
+        palette_free(pal);
+        image_pool_free(settings.images);
+        printf("All images generated successfully.\n");
+        return 0;
     }
 
-    // Calculate frames assigned to each child process
-    int frames_per_child = NUM_FRAMES / num_children;
-    int remaining_frames = NUM_FRAMES % num_children;
+    // -j runs every frame and tile on one set of work-stealing workers in
+    // this process instead of splitting by children and threads
+    if (workers > 0) {
+        printf("Generating Mandel movie with %d images using %d work-stealing workers...\n", NUM_FRAMES, workers);
+        printf("Using %s escape-time kernel\n", kernel_name(kernel));
+        settings.encoder = start_encoder(encoder_threads, queue_depth, strip_threads, settings.images);
+        settings.stream = streaming ? open_stream(stream_fd, format, image_width, image_height, settings.images) : NULL;
+        run_work_stealing(&settings, workers, order, costs);
+        if (settings.encoder) {
+            encoder_finish(settings.encoder);
+        }
+        if (settings.stream && (stream_close(settings.stream) != 0 || close(stream_fd) != 0)) {
+            exit(1);
+        }
+        palette_free(pal);
+        image_pool_free(settings.images);
+        printf("All images generated successfully.\n");
+        return 0;
+    }
+
+    printf("Generating Mandel movie with %d images using %d children...\n", NUM_FRAMES, num_children);
+    printf("Using %s escape-time kernel\n", kernel_name(kernel));
+
+    // Counting semaphore with one token per frame that may render at once.
+    // The name is private to this run and unlinked straight away: the
+    // children inherit the open semaphore, and two runs on one host cannot
+    // see or remove each other's.
+    if (max_concurrent == 0 || max_concurrent > num_children) {
+        max_concurrent = num_children;
+    }
+    char sem_name[64];
+    snprintf(sem_name, sizeof(sem_name), "/mandel_semaphore_%d", (int)getpid());
+    sem_t *sem = sem_open(sem_name, O_CREAT | O_EXCL, 0600, max_concurrent);
+    if (sem == SEM_FAILED) {
+        perror("Semaphore creation failed");
+        exit(1);
+    }
+    sem_unlink(sem_name);
+
+    // Children take the next frame from a shared counter whenever they are
+    // free. Frames are handed out most expensive first, so the long ones
+    // are not left running at the end.
+    atomic_int *next_frame = mmap(NULL, sizeof(atomic_int), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (next_frame == MAP_FAILED) {
+        perror("Failed to map the frame counter");
+        exit(1);
+    }
+    atomic_init(next_frame, 0);
+
+    // When streaming, each child sends its frames to the parent over a pipe
+    // and the parent writes them to the stream in order
+    frame_stream *stream = streaming ? open_stream(stream_fd, format, image_width, image_height, settings.images) : NULL;
+    struct pollfd pipes[num_children];
 
     // Fork child processes
     for (int child = 0; child < num_children; child++) {
+        int pipe_fds[2] = { -1, -1 };
+        if (stream && pipe(pipe_fds) != 0) {
+            perror("Failed to create a frame pipe");
+            exit(1);
+        }
+        pipes[child] = (struct pollfd){ .fd = pipe_fds[0], .events = POLLIN };
+
         pid_t pid = fork();
 
         if (pid < 0) {
@@ -195,61 +1359,85 @@ int main(int argc, char *argv[]) {
 
         if (pid == 0) {
             // Child process code
-            sem_wait(sem);
-            int start_frame = child * frames_per_child;
-            int end_frame = start_frame + frames_per_child;
-
-            if (child == num_children - 1) {
-                end_frame += remaining_frames;
+            if (stream) {
+                close(pipe_fds[0]);
+                close(stream_fd);
+                settings.stream = stream_create_pipe(pipe_fds[1], image_width, image_height, settings.images);
+                if (settings.stream == NULL) {
+                    fprintf(stderr, "Failed to set up the frame pipe\n");
+                    exit(1);
+                }
             }
-
-            for (int frame = start_frame; frame < end_frame; frame++) {
-                double scale = xscale / (1 + frame * 0.1);
-                char frame_outfile[300];
-                snprintf(frame_outfile, sizeof(frame_outfile), "%s_%d.jpg", output_filename, frame + 1);
-
-                generate_mandel_frame(xcenter, ycenter, scale, frame_outfile, image_width, image_height, max, num_threads);
+            // The pool lives for the whole run of frames; threads do not survive fork, so each child makes its own
+            thread_pool *pool = pool_create(num_threads);
+            if (pool == NULL) {
+                fprintf(stderr, "Failed to start %d threads\n", num_threads);
+                exit(1);
+            }
+            settings.encoder = start_encoder(encoder_threads, queue_depth, strip_threads, settings.images);
+            double busy[num_threads];
+            memset(busy, 0, sizeof(busy));
+            for (int taken = atomic_fetch_add(next_frame, 1); taken < NUM_FRAMES; taken = atomic_fetch_add(next_frame, 1)) {
+                int frame = order[taken];
+                kernel_stats stats = {0};
+                sem_wait(sem);
+                double started = seconds_now();
+                generate_mandel_frame(&settings, frame, pool, &stats, busy);
+                double seconds = seconds_now() - started;
+                sem_post(sem);
                 printf("Child %d generated frame %d\n", child, frame + 1);
+                print_frame_stats(&settings, frame, &stats, seconds);
+            }
+
+            pool_destroy(pool);
+            if (settings.encoder) {
+                encoder_finish(settings.encoder);
+            }
+            for (int t = 0; t < num_threads; t++) {
+                printf("Child %d thread %d: busy for %.3f seconds\n", child, t, busy[t]);
             }
 
-            sem_post(sem);
+            if (settings.stream && stream_close(settings.stream) != 0) {
+                exit(1);
+            }
             exit(0);
         }
+
+        if (stream) {
+            close(pipe_fds[1]);
+        }
+    }
+
+    // Write the streamed frames in order as they arrive from the children
+    for (int open_pipes = stream ? num_children : 0; open_pipes > 0; ) {
+        if (poll(pipes, num_children, -1) < 0) {
+            continue;
+        }
+        for (int child = 0; child < num_children; child++) {
+            if (pipes[child].fd >= 0 && pipes[child].revents && stream_receive(stream, pipes[child].fd) <= 0) {
+                close(pipes[child].fd);
+                pipes[child].fd = -1;
+                open_pipes--;
+            }
+        }
     }
 
     // Parent waits for all children to complete
     while (wait(NULL) > 0);
 
     sem_close(sem);
-    sem_unlink("/mandel_semaphore");
+    munmap(next_frame, sizeof(atomic_int));
+    if (stream && (stream_close(stream) != 0 || close(stream_fd) != 0)) {
+        exit(1);
+    }
+    palette_free(pal);
+    image_pool_free(settings.images);
 
     printf("All images generated successfully.\n");
 
     return 0;
 }
 
-// Calculate the number of iterations at a point
-int iterations_at_point(double x, double y, int max) {
-    double x0 = x;
-    double y0 = y;
-    int iter = 0;
-
-    while ((x * x + y * y <= 4) && iter < max) {
-        double xt = x * x - y * y + x0;
-        double yt = 2 * x * y + y0;
-        x = xt;
-        y = yt;
-        iter++;
-    }
-
-    return iter;
-}
-
-// Convert an iteration number to a color
-int iteration_to_color(int iters, int max) {
-    return 0xFFFFFF * iters / max;
-}
-
 // Show help message
 void show_help() {
     printf("Use: mandel [options]\n");
@@ -261,6 +1449,37 @@ void show_help() {
     printf("-W <pixels> Width of the image in pixels. (default=1000)\n");
     printf("-H <pixels> Height of the image in pixels. (default=1000)\n");
     printf("-o <file>   Set output file. (default=mandel.bmp)\n");
+    printf("-f <format> Output jpeg files, or one y4m or rgb video stream to -o (default stdout). (default=jpeg)\n");
+    printf("-i <bits>   Also write each frame's iteration counts to <file>_<n>.map, 16 or 32 bits\n");
+    printf("            per pixel, for mandel-recolor. (default=off)\n");
+    printf("-P <name>   Palette: classic, grey, fire, or hist for fire spread evenly over each\n");
+    printf("            frame's pixels by histogram equalization. (default=classic)\n");
+    printf("-e <engine> Precision engine: auto, double, dd or perturb. (default=auto)\n");
+    printf("-r <name>   Renderer: bands, ms for Mariani-Silver subdivision or refine for\n");
+    printf("            successive refinement. (default=bands)\n");
+    printf("-w          Write a preview after each coarse refinement pass (-r refine).\n");
+    printf("-A          Disable the series approximation for perturbation frames.\n");
+    printf("-j <num>    Render with this many work-stealing workers in one process instead of\n");
+    printf("            -c children of -t threads. (default=off)\n");
+    printf("-l <num>    Most frames the children render at the same time. (default=one per child)\n");
+    printf("-z <pixels> Size of the probe render that estimates each frame's cost, 0 for none. (default=32)\n");
+    printf("-E <num>    Encoder threads that write frames while the next ones compute, 0 for none. (default=0)\n");
+    printf("-q <num>    Finished frames that may wait for an encoder thread. (default=2)\n");
+    printf("-J <num>    Threads encoding horizontal strips of each JPEG. (default=1)\n");
+    printf("-K <num>    Render every num-th frame (and the last) as a keyframe and resample the\n");
+    printf("            frames from the keyframes around them, on the -t threads of one process.\n");
+    printf("            (default=0, compute every frame)\n");
+    printf("-Q <num>    Keyframe size as a multiple of the frame size, 1-8: higher is sharper\n");
+    printf("            and slower. (default=2)\n");
+    printf("-S <rows>   Render only the first frame's view, as one image <file>.jpg of any\n");
+    printf("            size, in bands of this many rows on the -t threads, encoding each\n");
+    printf("            band as soon as the ones above it are done.\n");
+    printf("-T <pixels> Size of the square tiles threads take work in. (default=64)\n");
+    printf("-k <kernel> Escape-time kernel: auto, scalar, avx2 or avx512. (default=auto)\n");
+    printf("-B          Disable the main cardioid and period-2 bulb checks.\n");
+    printf("-M          Compute rows mirrored across the real axis instead of copying them.\n");
+    printf("-N          Disable cycle detection for interior points.\n");
+    printf("-V          Validate each frame against the kernel without shortcuts.\n");
     printf("-h          Show this help text.\n");
     printf("\nSome examples are:\n");
     printf("mandel -x -0.5 -y -0.5 -s 0.2\n");
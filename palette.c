@@ -0,0 +1,113 @@
+///
+//  palette.c
+//  Turning iteration counts into colors through a lookup table with one
+//  entry per count.
+///
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <immintrin.h>
+#include "palette.h"
+
+static const char *names[] = { "classic", "grey", "fire", "hist" };
+
+int palette_parse(const char *name) {
+    for (int k = 0; k < (int)(sizeof(names) / sizeof(names[0])); k++) {
+        if (strcmp(name, names[k]) == 0) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+// Color at position num/den of the gradient. The arithmetic is 64-bit:
+// 0xFFFFFF times a count overflows an int from count 128 on.
+static unsigned int gradient(palette_type type, uint64_t num, uint64_t den) {
+    switch (type) {
+        case PALETTE_CLASSIC:
+            return 0xFFFFFF * num / den;
+        case PALETTE_GREY:
+            return 255 * num / den * 0x010101;
+        default: {
+            unsigned int t = 3 * 255 * num / den;
+            unsigned int r = t < 255 ? t : 255;
+            unsigned int g = t < 255 ? 0 : t < 510 ? t - 255 : 255;
+            unsigned int b = t < 510 ? 0 : t - 510;
+            return r << 16 | g << 8 | b;
+        }
+    }
+}
+
+palette *palette_create(palette_type type, int max) {
+    palette *pal = malloc(sizeof(palette));
+    if (pal == NULL) {
+        return NULL;
+    }
+    pal->type = type;
+    pal->max = max;
+    pal->colors = malloc(((size_t)max + 1) * sizeof(unsigned int));
+    if (pal->colors == NULL) {
+        free(pal);
+        return NULL;
+    }
+    for (int n = 0; n <= max; n++) {
+        pal->colors[n] = gradient(type, n, max);
+    }
+    return pal;
+}
+
+void palette_equalize(palette *pal, const size_t *histogram) {
+    uint64_t escaped = 0;
+    for (int n = 0; n < pal->max; n++) {
+        escaped += histogram[n];
+    }
+    if (escaped == 0) {
+        return;
+    }
+
+    // Count n gets the color of the share of escaped pixels below it
+    uint64_t below = 0;
+    for (int n = 0; n < pal->max; n++) {
+        pal->colors[n] = gradient(pal->type, below, escaped);
+        below += histogram[n];
+    }
+}
+
+// Eight pixels at a time: gather their colors from the table, pack each
+// 128-bit half down to 12 RGB bytes and store the halves 12 bytes apart.
+// Each store writes 4 bytes past its pixels, which the next store or the
+// scalar tail overwrites. Returns how many pixels were done.
+__attribute__((target("avx2")))
+static int colorize_avx2(const unsigned int *colors, const int *iters, int count, unsigned char *rgb) {
+    const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                             2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    int i = 0;
+
+    // The second store runs to byte 3 * i + 28, so keep 10 pixels of room
+    for (; i + 10 <= count; i += 8) {
+        __m256i index = _mm256_loadu_si256((const __m256i *)(iters + i));
+        __m256i packed = _mm256_shuffle_epi8(_mm256_i32gather_epi32((const int *)colors, index, 4), shuffle);
+        _mm_storeu_si128((__m128i *)(rgb + 3 * i), _mm256_castsi256_si128(packed));
+        _mm_storeu_si128((__m128i *)(rgb + 3 * i + 12), _mm256_extracti128_si256(packed, 1));
+    }
+    return i;
+}
+
+void palette_colorize(const palette *pal, const int *iters, int count, unsigned char *rgb) {
+    int i = 0;
+
+    if (__builtin_cpu_supports("avx2")) {
+        i = colorize_avx2(pal->colors, iters, count, rgb);
+    }
+    for (; i < count; i++) {
+        unsigned int color = pal->colors[iters[i]];
+        rgb[3 * i + 0] = color >> 16;
+        rgb[3 * i + 1] = color >> 8;
+        rgb[3 * i + 2] = color;
+    }
+}
+
+void palette_free(palette *pal) {
+    free(pal->colors);
+    free(pal);
+}
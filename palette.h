@@ -0,0 +1,44 @@
+///
+//  palette.h
+//  Turning iteration counts into colors through a lookup table with one
+//  entry per count, built once so coloring a pixel is a single load.
+///
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <stddef.h>
+
+typedef enum {
+    PALETTE_CLASSIC,    // the count scaled to 0 to 0xFFFFFF and used as 0xRRGGBB
+    PALETTE_GREY,       // black to white
+    PALETTE_FIRE,       // black through red and yellow to white
+    PALETTE_HIST        // fire, spread evenly over the escaped pixels of each frame
+} palette_type;
+
+// colors[n] is the 0xRRGGBB color of count n, for n from 0 to max
+typedef struct {
+    palette_type type;
+    int max;
+    unsigned int *colors;
+} palette;
+
+// Palette named name (classic, grey, fire or hist), or -1 if there is none
+int palette_parse(const char *name);
+
+// Build the table for counts up to max. A PALETTE_HIST table holds the
+// plain fire gradient until palette_equalize. Returns NULL if out of memory.
+palette *palette_create(palette_type type, int max);
+
+// Rebuild a PALETTE_HIST table for one frame. histogram[n] is how many of
+// its pixels have count n, for n from 0 to max. Pixels at max keep the
+// top color; the gradient is spread over the others so each color covers
+// about as many pixels as any other.
+void palette_equalize(palette *pal, const size_t *histogram);
+
+// Write the colors of count counts to rgb as packed RGB bytes. Uses AVX2
+// gathers when the CPU has them.
+void palette_colorize(const palette *pal, const int *iters, int count, unsigned char *rgb);
+
+void palette_free(palette *pal);
+
+#endif  /* Compile guard */
@@ -0,0 +1,237 @@
+///
+//  perturb.c
+//  Perturbation engine for deep zooms.
+//
+//  With the reference orbit Z and a pixel orbit z = Z + dz, the offset
+//  follows dz' = 2*Z*dz + dz^2 + dc, which stays accurate in double long
+//  after z itself has run out of bits. When |z| drops below |dz| the
+//  offset would lose precision (a glitch), so the pixel is rebased onto
+//  the start of the reference orbit with dz = z.
+//
+//  Series approximation: writing dz = sum(A_k * dc^k), the recurrence
+//  gives A_k' = 2*Z*A_k + sum(A_i * A_j, i + j = k), with A_1 = 1 and the
+//  rest 0 at the start. The coefficients are advanced along the reference
+//  orbit for as long as the truncated series stays within a fraction of
+//  a pixel; every pixel then starts from the series value at that point.
+///
+#include <stdlib.h>
+#include <math.h>
+#include "perturb.h"
+
+// Allowed series error, as a fraction of a pixel mapped through the orbit
+#define SERIES_TOLERANCE 1e-3
+
+// Offsets (in units of the radius) of the points used to check the series
+#define SERIES_PROBES 8
+static const double probe_dir[SERIES_PROBES][2] = {
+    { -0.70710678, -0.70710678 }, { 0.70710678, -0.70710678 },
+    { -0.70710678,  0.70710678 }, { 0.70710678,  0.70710678 },
+    { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 }
+};
+
+// Evaluate the series at (dcr, dci) with coefficients (ar, ai)
+static void series_eval(const double *ar, const double *ai, double dcr, double dci, double *out_r, double *out_i) {
+    double sr = 0, si = 0;
+    double pr = dcr, pi = dci;  // dc^(k+1)
+
+    for (int k = 0; k < SERIES_TERMS; k++) {
+        sr += ar[k] * pr - ai[k] * pi;
+        si += ar[k] * pi + ai[k] * pr;
+        double t = pr * dcr - pi * dci;
+        pi = pr * dci + pi * dcr;
+        pr = t;
+    }
+
+    *out_r = sr;
+    *out_i = si;
+}
+
+// Advance the series coefficients along the reference orbit and find how
+// many iterations every pixel within radius of the center can skip.
+static void series_compute(reference_orbit *ref, int max, double pixel_size, double radius) {
+    double ar[SERIES_TERMS] = { 1 }, ai[SERIES_TERMS] = { 0 };
+    double probe_r[SERIES_PROBES], probe_i[SERIES_PROBES];
+    double dcr[SERIES_PROBES], dci[SERIES_PROBES];
+
+    for (int p = 0; p < SERIES_PROBES; p++) {
+        dcr[p] = probe_r[p] = probe_dir[p][0] * radius;
+        dci[p] = probe_i[p] = probe_dir[p][1] * radius;
+    }
+
+    ref->skip = 0;
+    for (int k = 0; k < SERIES_TERMS; k++) {
+        ref->ar[k] = ar[k];
+        ref->ai[k] = ai[k];
+    }
+
+    // m is the reference index the coefficients currently describe
+    for (int m = 1; m < ref->length - 1 && m - 1 < max; m++) {
+        double zr = ref->zr[m], zi = ref->zi[m];
+        double nr[SERIES_TERMS], ni[SERIES_TERMS];
+
+        for (int k = 0; k < SERIES_TERMS; k++) {
+            // 2*Z*A_k plus the products of lower terms whose orders add up to k
+            nr[k] = 2 * (zr * ar[k] - zi * ai[k]);
+            ni[k] = 2 * (zr * ai[k] + zi * ar[k]);
+            for (int i = 0; i < k; i++) {
+                int j = k - 1 - i;
+                nr[k] += ar[i] * ar[j] - ai[i] * ai[j];
+                ni[k] += ar[i] * ai[j] + ai[i] * ar[j];
+            }
+        }
+        nr[0] += 1;
+
+        // Truncation error bound: the last term has to stay well under a
+        // pixel once mapped through the derivative A_1
+        double deriv = hypot(nr[0], ni[0]);
+        double allowed = SERIES_TOLERANCE * deriv * pixel_size;
+        double last = hypot(nr[SERIES_TERMS - 1], ni[SERIES_TERMS - 1]) * pow(radius, SERIES_TERMS);
+        if (!isfinite(last) || !isfinite(deriv) || last > allowed) {
+            break;
+        }
+
+        // The probes iterate exactly; the series must agree with all of
+        // them and none may be close to escaping or needing a rebase
+        int ok = 1;
+        for (int p = 0; p < SERIES_PROBES && ok; p++) {
+            double r = probe_r[p], i = probe_i[p];
+            double tr = 2 * (zr * r - zi * i) + r * r - i * i + dcr[p];
+            double ti = 2 * (zr * i + zi * r) + 2 * r * i + dci[p];
+            probe_r[p] = tr;
+            probe_i[p] = ti;
+
+            double sr, si;
+            series_eval(nr, ni, dcr[p], dci[p], &sr, &si);
+            double x = ref->zr[m + 1] + tr, y = ref->zi[m + 1] + ti;
+            double mag = x * x + y * y;
+            if (hypot(sr - tr, si - ti) > allowed || mag > 4 || mag < tr * tr + ti * ti) {
+                ok = 0;
+            }
+        }
+        if (!ok) {
+            break;
+        }
+
+        for (int k = 0; k < SERIES_TERMS; k++) {
+            ar[k] = ref->ar[k] = nr[k];
+            ai[k] = ref->ai[k] = ni[k];
+        }
+        ref->skip = m;
+    }
+}
+
+reference_orbit *reference_orbit_compute(const bigfloat *cx, const bigfloat *cy, int max, double pixel_size, double radius) {
+    reference_orbit *ref = malloc(sizeof(reference_orbit));
+    if (ref == NULL) {
+        return NULL;
+    }
+
+    ref->zr = malloc((max + 2) * sizeof(double));
+    ref->zi = malloc((max + 2) * sizeof(double));
+    if (ref->zr == NULL || ref->zi == NULL) {
+        reference_orbit_free(ref);
+        return NULL;
+    }
+
+    int n = bf_limbs_for(pixel_size);
+    bigfloat x0 = *cx, y0 = *cy;
+    bf_set_precision(&x0, n);
+    bf_set_precision(&y0, n);
+
+    bigfloat x = x0, y = y0, x2, y2, xy;
+
+    ref->limbs = n;
+    ref->zr[0] = 0;
+    ref->zi[0] = 0;
+    ref->length = 1;
+
+    while (ref->length < max + 2) {
+        double dx = bf_to_double(&x);
+        double dy = bf_to_double(&y);
+        ref->zr[ref->length] = dx;
+        ref->zi[ref->length] = dy;
+        ref->length++;
+        if (dx * dx + dy * dy > 4) {
+            break;
+        }
+
+        bf_mul(&x2, &x, &x);
+        bf_mul(&y2, &y, &y);
+        bf_mul(&xy, &x, &y);
+        bf_sub(&x, &x2, &y2);
+        bf_add(&x, &x, &x0);
+        bf_add(&y, &xy, &xy);
+        bf_add(&y, &y, &y0);
+    }
+
+    ref->skip = 0;
+    if (radius > 0) {
+        series_compute(ref, max, pixel_size, radius);
+    }
+
+    return ref;
+}
+
+void reference_orbit_free(reference_orbit *ref) {
+    if (ref) {
+        free(ref->zr);
+        free(ref->zi);
+        free(ref);
+    }
+}
+
+static int perturb_point(const reference_orbit *ref, double dcr, double dci, int max, unsigned long *rebased) {
+    const double *zr = ref->zr;
+    const double *zi = ref->zi;
+    int last = ref->length - 1;
+    double dzr, dzi;
+    int m = 1 + ref->skip;
+    int iter = ref->skip;
+
+    if (ref->skip > 0) {
+        series_eval(ref->ar, ref->ai, dcr, dci, &dzr, &dzi);
+    } else {
+        dzr = dcr;
+        dzi = dci;
+    }
+
+    while (iter < max) {
+        double x = zr[m] + dzr;
+        double y = zi[m] + dzi;
+        double mag = x * x + y * y;
+        if (mag > 4) {
+            break;
+        }
+
+        // Rebase when the pixel passes closer to 0 than to the reference,
+        // or when the reference orbit has run out
+        if (mag < dzr * dzr + dzi * dzi || m == last) {
+            dzr = x;
+            dzi = y;
+            m = 0;
+            (*rebased)++;
+        }
+
+        double ndzr = 2 * (zr[m] * dzr - zi[m] * dzi) + dzr * dzr - dzi * dzi + dcr;
+        double ndzi = 2 * (zr[m] * dzi + zi[m] * dzr) + 2 * dzr * dzi + dci;
+        dzr = ndzr;
+        dzi = ndzi;
+        m++;
+        iter++;
+    }
+
+    return iter;
+}
+
+void perturb_row(const reference_orbit *ref, const double *dxs, double dy, int count, int max, int *iters, kernel_stats *stats) {
+    unsigned long rebased = 0;
+
+    for (int i = 0; i < count; i++) {
+        iters[i] = perturb_point(ref, dxs[i], dy, max, &rebased);
+    }
+
+    if (stats) {
+        stats->rebased += rebased;
+        stats->skipped += (unsigned long)ref->skip * count;
+    }
+}
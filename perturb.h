@@ -0,0 +1,47 @@
+///
+//  perturb.h
+//  Perturbation engine for deep zooms.
+//
+//  One reference orbit per frame is computed at the frame center in
+//  arbitrary precision; each pixel then only iterates its (small)
+//  offset from that orbit in double precision. A series approximation
+//  of the offset lets every pixel skip the start of the orbit.
+///
+#ifndef PERTURB_H
+#define PERTURB_H
+
+#include "bigfloat.h"
+#include "kernel.h"
+
+// Number of terms in the series approximation
+#define SERIES_TERMS 4
+
+// Reference orbit rounded to double. Entry 0 is the origin and entry k
+// is the center after k-1 iterations, so a pixel can rebase onto the
+// start of the orbit at any time. The last entry may have escaped.
+typedef struct {
+    double *zr;
+    double *zi;
+    int length;
+    int limbs;  // precision the orbit was computed with
+
+    // Series approximation: after skip iterations a pixel's offset is
+    // sum(a[k] * dc^(k+1)). skip is 0 when the series is not used.
+    int skip;
+    double ar[SERIES_TERMS];
+    double ai[SERIES_TERMS];
+} reference_orbit;
+
+// Compute the reference orbit at (cx, cy) with enough precision for pixels
+// pixel_size apart. When radius is non-zero, also fit the series
+// approximation for pixel offsets up to radius from the center and pick
+// the number of iterations it can skip. Returns NULL if out of memory.
+reference_orbit *reference_orbit_compute(const bigfloat *cx, const bigfloat *cy, int max, double pixel_size, double radius);
+
+void reference_orbit_free(reference_orbit *ref);
+
+// Calculate the iterations for count points of one row, given as offsets
+// (dxs[i], dy) from the reference orbit's center. stats may be NULL.
+void perturb_row(const reference_orbit *ref, const double *dxs, double dy, int count, int max, int *iters, kernel_stats *stats);
+
+#endif  /* Compile guard */
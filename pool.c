@@ -0,0 +1,138 @@
+///
+//  pool.c
+//  A fixed set of worker threads that is created once per process and
+//  runs jobs from a queue, so frames do not pay for thread creation.
+///
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "pool.h"
+
+typedef struct {
+    pool_job_fn fn;
+    void *arg;
+} pool_job;
+
+struct thread_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t work;     // signalled when a job is queued or on shutdown
+    pthread_cond_t idle;     // signalled when the last pending job finishes
+    pool_job *queue;         // ring buffer
+    int head, count, capacity;
+    int pending;             // queued plus running jobs
+    int shutdown;
+    int nthreads;
+    pthread_t *threads;
+};
+
+static void *pool_worker(void *arg) {
+    thread_pool *pool = (thread_pool *)arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->count == 0 && !pool->shutdown) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        if (pool->count == 0) {
+            break;
+        }
+
+        pool_job job = pool->queue[pool->head];
+        pool->head = (pool->head + 1) % pool->capacity;
+        pool->count--;
+        pthread_mutex_unlock(&pool->lock);
+
+        job.fn(job.arg);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0) {
+            pthread_cond_broadcast(&pool->idle);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+thread_pool *pool_create(int nthreads) {
+    thread_pool *pool = calloc(1, sizeof(thread_pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    pool->capacity = 64;
+    pool->queue = malloc(pool->capacity * sizeof(pool_job));
+    pool->threads = malloc(nthreads * sizeof(pthread_t));
+    if (pool->queue == NULL || pool->threads == NULL) {
+        free(pool->queue);
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+
+    for (int t = 0; t < nthreads; t++) {
+        if (pthread_create(&pool->threads[t], NULL, pool_worker, pool) != 0) {
+            pool_destroy(pool);
+            return NULL;
+        }
+        pool->nthreads++;
+    }
+    return pool;
+}
+
+int pool_size(const thread_pool *pool) {
+    return pool->nthreads;
+}
+
+void pool_submit(thread_pool *pool, pool_job_fn fn, void *arg) {
+    pthread_mutex_lock(&pool->lock);
+
+    if (pool->count == pool->capacity) {
+        pool_job *queue = malloc(2 * pool->capacity * sizeof(pool_job));
+        if (queue == NULL) {
+            fprintf(stderr, "Failed to grow the job queue\n");
+            exit(1);
+        }
+        for (int k = 0; k < pool->count; k++) {
+            queue[k] = pool->queue[(pool->head + k) % pool->capacity];
+        }
+        free(pool->queue);
+        pool->queue = queue;
+        pool->head = 0;
+        pool->capacity *= 2;
+    }
+
+    pool->queue[(pool->head + pool->count) % pool->capacity] = (pool_job){ fn, arg };
+    pool->count++;
+    pool->pending++;
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_wait(thread_pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0) {
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_destroy(thread_pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int t = 0; t < pool->nthreads; t++) {
+        pthread_join(pool->threads[t], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->idle);
+    free(pool->queue);
+    free(pool->threads);
+    free(pool);
+}
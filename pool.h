@@ -0,0 +1,27 @@
+///
+//  pool.h
+//  A fixed set of worker threads that is created once per process and
+//  runs jobs from a queue, so frames do not pay for thread creation.
+///
+#ifndef POOL_H
+#define POOL_H
+
+typedef struct thread_pool thread_pool;
+
+typedef void (*pool_job_fn)(void *arg);
+
+// Start nthreads workers. Returns NULL if out of memory or threads.
+thread_pool *pool_create(int nthreads);
+
+int pool_size(const thread_pool *pool);
+
+// Queue fn(arg) to run on the next idle worker
+void pool_submit(thread_pool *pool, pool_job_fn fn, void *arg);
+
+// Wait until every job submitted so far has finished
+void pool_wait(thread_pool *pool);
+
+// Finish the queued jobs, then stop and join the workers
+void pool_destroy(thread_pool *pool);
+
+#endif  /* Compile guard */
@@ -0,0 +1,130 @@
+///
+//  recolor.c
+//  mandel-recolor: color iteration maps written by mandel -i into JPEGs
+//  without computing the frames again.
+///
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "jpegrw.h"
+#include "itermap.h"
+#include "palette.h"
+
+static void show_help() {
+    printf("Use: mandel-recolor [options] <map>...\n");
+    printf("Writes <map without .map>.jpg for every iteration map given.\n");
+    printf("Where options are:\n");
+    printf("-P <name>   Palette: classic, grey, fire or hist. (default=classic)\n");
+    printf("-d <dir>    Write the JPEGs to this directory instead of next to the maps.\n");
+    printf("-h          Show this help text.\n");
+    printf("\nFor example:\n");
+    printf("mandel -i 16 -o frame && mandel-recolor -P hist frame_*.map\n\n");
+}
+
+// Color one map and write it as a JPEG. Returns 0 on success.
+static int recolor(const char *mapfile, const char *dir, palette_type type) {
+    itermap map;
+    if (itermap_open(&map, mapfile) != 0) {
+        fprintf(stderr, "%s is not an iteration map\n", mapfile);
+        return -1;
+    }
+
+    char outfile[512];
+    const char *name = mapfile;
+    if (dir && strrchr(mapfile, '/')) {
+        name = strrchr(mapfile, '/') + 1;
+    }
+    int len = (int)strlen(name);
+    if (len > 4 && strcmp(name + len - 4, ".map") == 0) {
+        len -= 4;
+    }
+    snprintf(outfile, sizeof(outfile), "%s%s%.*s.jpg", dir ? dir : "", dir ? "/" : "", len, name);
+
+    int width = map.header.width;
+    int height = map.header.height;
+    int max = map.header.max;
+    palette *pal = palette_create(type, max);
+    size_t *histogram = calloc((size_t)max + 1, sizeof(size_t));
+    if (pal == NULL || histogram == NULL) {
+        fprintf(stderr, "Out of memory coloring %s\n", mapfile);
+        exit(1);
+    }
+
+    // Counts past max can only come from a damaged map; they get the top color
+    if (type == PALETTE_HIST) {
+        for (int j = 0; j < height; j++) {
+            for (int i = 0; i < width; i++) {
+                unsigned int n = itermap_get(&map, i, j);
+                histogram[n < (unsigned int)max ? n : (unsigned int)max]++;
+            }
+        }
+        palette_equalize(pal, histogram);
+    }
+
+    imgRawImage *img = initRawImage(width, height);
+    unsigned int *colors = malloc(width * sizeof(unsigned int));
+    if (colors == NULL) {
+        fprintf(stderr, "Out of memory coloring %s\n", mapfile);
+        exit(1);
+    }
+    for (int j = 0; j < height; j++) {
+        for (int i = 0; i < width; i++) {
+            unsigned int n = itermap_get(&map, i, j);
+            colors[i] = pal->colors[n < (unsigned int)max ? n : (unsigned int)max];
+        }
+        // Map rows are stored top first; spans count rows from the bottom
+        writeSpanCOLOR(img, 0, height - 1 - j, width, colors);
+    }
+    itermap_close(&map);
+    palette_free(pal);
+    free(histogram);
+    free(colors);
+
+    int result = storeJpegImageFile(img, outfile);
+    freeRawImage(img);
+    if (result != 0) {
+        fprintf(stderr, "Failed to write %s\n", outfile);
+        return -1;
+    }
+    printf("Wrote %s\n", outfile);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *dir = NULL;
+    palette_type type = PALETTE_CLASSIC;
+    int c;
+
+    while ((c = getopt(argc, argv, "P:d:h")) != -1) {
+        switch (c) {
+            case 'P':
+                if (palette_parse(optarg) < 0) {
+                    fprintf(stderr, "Invalid palette %s. Use classic, grey, fire or hist.\n", optarg);
+                    return 1;
+                }
+                type = palette_parse(optarg);
+                break;
+            case 'd':
+                dir = optarg;
+                break;
+            case 'h':
+                show_help();
+                exit(1);
+                break;
+            default:
+                show_help();
+                return 1;
+        }
+    }
+    if (optind == argc) {
+        show_help();
+        return 1;
+    }
+
+    int failed = 0;
+    for (int k = optind; k < argc; k++) {
+        failed |= recolor(argv[k], dir, type) != 0;
+    }
+    return failed;
+}
@@ -0,0 +1,578 @@
+///
+//  render.c
+//  Frame setup shared by the renderers, the Mariani-Silver rectangle
+//  subdivision renderer and the successive refinement renderer.
+///
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "render.h"
+
+// Rectangles this thin are computed pixel by pixel instead of split
+#define MS_MIN_SIZE 16
+
+// Before a rectangle with an interior border is filled, the rings of
+// pixels this deep inside its border are computed and have to be interior
+// too. Channels of the outside thinner than a pixel can slip between two
+// border pixels (along the cusps where bulbs touch, or in from beyond the
+// frame edge), and the pixels they reach lie just inside the border.
+#define MS_GUARD_DEPTH 2
+
+// Pixels gathered per kernel call for columns and scattered points
+#define MS_GATHER 256
+
+// Grid spacing of the first successive refinement pass
+#define REFINE_START_STEP 8
+
+// Round an exact center to double-double
+static dd_real bf_to_dd(const bigfloat *a) {
+    bigfloat hi, rest;
+    dd_real r;
+
+    r.hi = bf_to_double(a);
+    bf_from_double(&hi, r.hi, a->n);
+    bf_sub(&rest, a, &hi);
+    r.lo = bf_to_double(&rest);
+    return r;
+}
+
+int frame_view_init(frame_view *view, double x, double y, const bigfloat *cx, const bigfloat *cy,
+                    engine_type engine, int use_series, double scale, int width, int height, int max) {
+    memset(view, 0, sizeof(*view));
+    view->width = width;
+    view->height = height;
+    view->scale = scale;
+    view->xmin = x - scale / 2;
+    view->xmax = x + scale / 2;
+    view->ymin = y - scale / 2;
+    view->ymax = y + scale / 2;
+    view->y = y;
+    view->params.max = max;
+    view->params.pixel_size = (view->xmax - view->xmin) / width;
+
+    if (engine == ENGINE_AUTO) {
+        engine = scale < PERTURB_SCALE ? ENGINE_PERTURB : scale < DD_SCALE ? ENGINE_DD : ENGINE_DOUBLE;
+    }
+    view->engine = engine;
+
+    if (engine == ENGINE_PERTURB) {
+        // The series has to cover the frame corners, half a scale away on both axes
+        double radius = use_series ? scale * M_SQRT1_2 : 0;
+        view->ref = reference_orbit_compute(cx, cy, max, scale / width, radius);
+        if (view->ref == NULL) {
+            return -1;
+        }
+    }
+
+    view->xs = malloc(width * sizeof(double));
+    view->xs_lo = malloc(width * sizeof(double));
+    if (view->xs == NULL || view->xs_lo == NULL) {
+        frame_view_free(view);
+        return -1;
+    }
+
+    // The real parts are the same for every row, so the row kernel can run on all of them at once.
+    // With perturbation they are offsets from the frame center instead, and
+    // with double-double they are split into high and low parts.
+    dd_real xcenter = bf_to_dd(cx);
+    view->ycenter = bf_to_dd(cy);
+    for (int i = 0; i < width; i++) {
+        double dx = -scale / 2 + i * scale / width;
+        if (engine == ENGINE_PERTURB) {
+            view->xs[i] = dx;
+        } else if (engine == ENGINE_DD) {
+            dd_real xi = dd_add_double(xcenter, dx);
+            view->xs[i] = xi.hi;
+            view->xs_lo[i] = xi.lo;
+        } else {
+            view->xs[i] = view->xmin + i * (view->xmax - view->xmin) / width;
+        }
+    }
+
+    return 0;
+}
+
+void frame_view_free(frame_view *view) {
+    free(view->xs);
+    free(view->xs_lo);
+    reference_orbit_free(view->ref);
+    view->xs = view->xs_lo = NULL;
+    view->ref = NULL;
+}
+
+// Imaginary part of row j as an offset from the center. It is measured
+// from the middle of the frame, so rows the same distance above and below
+// it get exactly opposite offsets.
+static double row_offset(const frame_view *view, int j) {
+    return (j - view->height / 2.0) * view->scale / view->height;
+}
+
+void view_span(const frame_view *view, int j, int i, int count, int *iters, kernel_stats *stats) {
+    double dy = row_offset(view, j);
+
+    if (view->engine == ENGINE_PERTURB) {
+        perturb_row(view->ref, view->xs + i, dy, count, view->params.max, iters, stats);
+    } else if (view->engine == ENGINE_DD) {
+        iterations_row_dd(view->xs + i, view->xs_lo + i, dd_add_double(view->ycenter, dy), count, view->params.max, iters);
+    } else {
+        iterations_row(&view->params, view->xs + i, view->y + dy, count, iters, stats);
+    }
+}
+
+int view_mirror_row(const frame_view *view, int j) {
+    if (view->engine == ENGINE_PERTURB) {
+        return -1;
+    }
+
+    // The row where the mirror image of row j would be, give or take rounding
+    double dy = row_offset(view, j);
+    double guess = view->height / 2.0 + (-2 * view->y - dy) * view->height / view->scale;
+    if (!(fabs(guess) < view->height + 2.0)) {
+        return -1;
+    }
+
+    // The kernels treat c and its conjugate alike, bit for bit, so only an
+    // exact match is good enough
+    int m0 = (int)floor(guess + 0.5);
+    for (int m = m0 - 1; m <= m0 + 1; m++) {
+        if (m < 0 || m >= view->height || m == j) {
+            continue;
+        }
+        if (view->engine == ENGINE_DD) {
+            dd_real a = dd_add_double(view->ycenter, dy);
+            dd_real b = dd_add_double(view->ycenter, row_offset(view, m));
+            if (a.hi == -b.hi && a.lo == -b.lo) {
+                return m;
+            }
+        } else if (view->y + dy == -(view->y + row_offset(view, m))) {
+            return m;
+        }
+    }
+    return -1;
+}
+
+void view_column(const frame_view *view, int i, int j, int count, int *iters, kernel_stats *stats) {
+    // Only the double kernels take a different imaginary part per lane
+    if (view->engine != ENGINE_DOUBLE) {
+        for (int k = 0; k < count; k++) {
+            view_span(view, j + k, i, 1, iters + k, stats);
+        }
+        return;
+    }
+
+    double xs[MS_GATHER], ys[MS_GATHER];
+    for (int k = 0; k < MS_GATHER; k++) {
+        xs[k] = view->xs[i];
+    }
+    for (int start = 0; start < count; start += MS_GATHER) {
+        int n = count - start < MS_GATHER ? count - start : MS_GATHER;
+        for (int k = 0; k < n; k++) {
+            ys[k] = view->y + row_offset(view, j + start + k);
+        }
+        iterations_points(&view->params, xs, ys, n, iters + start, stats);
+    }
+}
+
+// Compute the pixels of row j at the n columns in cols, MS_GATHER at a
+// time, so the row kernel still sees a contiguous span
+static void view_gather(const frame_view *view, int j, const int *cols, int n, int *iters, kernel_stats *stats) {
+    frame_view gathered = *view;
+    double xs[MS_GATHER], xs_lo[MS_GATHER];
+
+    gathered.xs = xs;
+    gathered.xs_lo = xs_lo;
+    for (int start = 0; start < n; start += MS_GATHER) {
+        int count = n - start < MS_GATHER ? n - start : MS_GATHER;
+        for (int k = 0; k < count; k++) {
+            xs[k] = view->xs[cols[start + k]];
+            xs_lo[k] = view->xs_lo[cols[start + k]];
+        }
+        view_span(&gathered, j, 0, count, iters + start, stats);
+    }
+}
+
+// Inclusive pixel bounds of a rectangle
+typedef struct {
+    int x0, y0, x1, y1;
+} ms_rect;
+
+struct ms_state {
+    const frame_view *view;
+    int *iters;
+    int validate;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    ms_rect *stack;
+    int top, capacity;
+    int pending;  // rectangles pushed but not finished yet
+};
+
+ms_state *ms_create(const frame_view *view, int *iters) {
+    ms_state *ms = malloc(sizeof(ms_state));
+    if (ms == NULL) {
+        return NULL;
+    }
+
+    ms->view = view;
+    ms->iters = iters;
+    ms->validate = kernel_get_options() & KERNEL_OPT_VALIDATE;
+    pthread_mutex_init(&ms->lock, NULL);
+    pthread_cond_init(&ms->cond, NULL);
+    ms->capacity = 64;
+    ms->stack = malloc(ms->capacity * sizeof(ms_rect));
+    if (ms->stack == NULL) {
+        ms_free(ms);
+        return NULL;
+    }
+
+    // -1 marks pixels that have not been computed yet
+    memset(iters, 0xFF, (size_t)view->width * view->height * sizeof(int));
+
+    ms_rect all = { 0, 0, view->width - 1, view->height - 1 };
+    ms->stack[0] = all;
+    ms->top = 1;
+    ms->pending = 1;
+    return ms;
+}
+
+void ms_free(ms_state *ms) {
+    pthread_mutex_destroy(&ms->lock);
+    pthread_cond_destroy(&ms->cond);
+    free(ms->stack);
+    free(ms);
+}
+
+// Compute the pixels of row j from x0 to x1 that are still unknown
+static void ms_compute_row(ms_state *ms, int j, int x0, int x1, kernel_stats *stats) {
+    int *row = ms->iters + (size_t)j * ms->view->width;
+
+    for (int i = x0; i <= x1; i++) {
+        if (row[i] >= 0) {
+            continue;
+        }
+        int run = i;
+        while (run <= x1 && row[run] < 0) {
+            run++;
+        }
+        view_span(ms->view, j, i, run - i, row + i, stats);
+        i = run;
+    }
+}
+
+// Compute the pixels of column i from y0 to y1 that are still unknown
+static void ms_compute_column(ms_state *ms, int i, int y0, int y1, kernel_stats *stats) {
+    int width = ms->view->width;
+    int column[MS_GATHER];
+
+    for (int j = y0; j <= y1; j++) {
+        if (ms->iters[(size_t)j * width + i] >= 0) {
+            continue;
+        }
+        int run = j;
+        while (run <= y1 && run - j < MS_GATHER && ms->iters[(size_t)run * width + i] < 0) {
+            run++;
+        }
+        view_column(ms->view, i, j, run - j, column, stats);
+        for (int k = j; k < run; k++) {
+            ms->iters[(size_t)k * width + i] = column[k - j];
+        }
+        j = run - 1;
+    }
+}
+
+// Compute the unknown pixels strictly inside r. The double kernel takes
+// them MS_GATHER at a time whatever row they are on, so rectangles too
+// small to split still keep its vector lanes busy.
+static void ms_compute_inside(ms_state *ms, ms_rect r, kernel_stats *stats) {
+    const frame_view *view = ms->view;
+
+    if (view->engine != ENGINE_DOUBLE) {
+        for (int j = r.y0 + 1; j < r.y1; j++) {
+            ms_compute_row(ms, j, r.x0 + 1, r.x1 - 1, stats);
+        }
+        return;
+    }
+
+    double xs[MS_GATHER], ys[MS_GATHER];
+    int found[MS_GATHER];
+    int *pixels[MS_GATHER];
+    int n = 0;
+
+    for (int j = r.y0 + 1; j < r.y1; j++) {
+        int *row = ms->iters + (size_t)j * view->width;
+        double y = view->y + row_offset(view, j);
+
+        for (int i = r.x0 + 1; i < r.x1; i++) {
+            if (row[i] >= 0) {
+                continue;
+            }
+            xs[n] = view->xs[i];
+            ys[n] = y;
+            pixels[n++] = row + i;
+            if (n == MS_GATHER) {
+                iterations_points(&view->params, xs, ys, n, found, stats);
+                for (int k = 0; k < n; k++) {
+                    *pixels[k] = found[k];
+                }
+                n = 0;
+            }
+        }
+    }
+    if (n > 0) {
+        iterations_points(&view->params, xs, ys, n, found, stats);
+        for (int k = 0; k < n; k++) {
+            *pixels[k] = found[k];
+        }
+    }
+}
+
+// Returns 1 if every pixel on the border of r equals value
+static int ms_uniform_border(const ms_state *ms, ms_rect r, int value) {
+    const int *iters = ms->iters;
+    int width = ms->view->width;
+
+    for (int i = r.x0; i <= r.x1; i++) {
+        if (iters[(size_t)r.y0 * width + i] != value || iters[(size_t)r.y1 * width + i] != value) {
+            return 0;
+        }
+    }
+    for (int j = r.y0; j <= r.y1; j++) {
+        if (iters[(size_t)j * width + r.x0] != value || iters[(size_t)j * width + r.x1] != value) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Process one rectangle whose border is known (except for the first one).
+// Returns how many child rectangles were written to children.
+static int ms_process(ms_state *ms, ms_rect r, ms_rect children[2], kernel_stats *stats) {
+    const frame_view *view = ms->view;
+    int width = view->width;
+    int *iters = ms->iters;
+    int value = view->params.max;
+
+    ms_compute_row(ms, r.y0, r.x0, r.x1, stats);
+    ms_compute_row(ms, r.y1, r.x0, r.x1, stats);
+    ms_compute_column(ms, r.x0, r.y0, r.y1, stats);
+    ms_compute_column(ms, r.x1, r.y0, r.y1, stats);
+
+    if (r.x1 - r.x0 < MS_MIN_SIZE || r.y1 - r.y0 < MS_MIN_SIZE) {
+        ms_compute_inside(ms, r, stats);
+        return 0;
+    }
+
+    // Only the inside of the set is filled: it has no holes, so a closed
+    // border of interior points cannot enclose anything but more interior.
+    // Escape-time bands can hide whole mini-sets behind a uniform border.
+    // The rings inside the border are computed first and the rectangle is
+    // only filled if they are interior as well.
+    int uniform = ms_uniform_border(ms, r, value);
+    for (int d = 1; uniform && d <= MS_GUARD_DEPTH; d++) {
+        ms_rect ring = { r.x0 + d, r.y0 + d, r.x1 - d, r.y1 - d };
+        ms_compute_row(ms, ring.y0, ring.x0, ring.x1, stats);
+        ms_compute_row(ms, ring.y1, ring.x0, ring.x1, stats);
+        ms_compute_column(ms, ring.x0, ring.y0, ring.y1, stats);
+        ms_compute_column(ms, ring.x1, ring.y0, ring.y1, stats);
+        uniform = ms_uniform_border(ms, ring, value);
+    }
+
+    if (uniform) {
+        int inner = r.x1 - r.x0 - 1;
+        int *check = ms->validate ? malloc(inner * sizeof(int)) : NULL;
+
+        for (int j = r.y0 + 1; j < r.y1; j++) {
+            int *row = iters + (size_t)j * width + r.x0 + 1;
+            if (check) {
+                view_span(view, j, r.x0 + 1, inner, check, NULL);
+            }
+            for (int i = 0; i < inner; i++) {
+                if (row[i] >= 0) {
+                    continue;
+                }
+                row[i] = value;
+                stats->filled++;
+                if (check) {
+                    stats->validated++;
+                    stats->mismatched += check[i] != value;
+                }
+            }
+        }
+        free(check);
+        return 0;
+    }
+
+    // Split across the longer side. The dividing line is computed here so
+    // both halves start with a complete border and never write to it.
+    // Pixels of the guard rings are kept and not computed again.
+    if (r.x1 - r.x0 >= r.y1 - r.y0) {
+        int xm = (r.x0 + r.x1) / 2;
+        ms_compute_column(ms, xm, r.y0 + 1, r.y1 - 1, stats);
+        children[0] = (ms_rect){ r.x0, r.y0, xm, r.y1 };
+        children[1] = (ms_rect){ xm, r.y0, r.x1, r.y1 };
+    } else {
+        int ym = (r.y0 + r.y1) / 2;
+        ms_compute_row(ms, ym, r.x0 + 1, r.x1 - 1, stats);
+        children[0] = (ms_rect){ r.x0, r.y0, r.x1, ym };
+        children[1] = (ms_rect){ r.x0, ym, r.x1, r.y1 };
+    }
+    return 2;
+}
+
+void ms_run(ms_state *ms, kernel_stats *stats) {
+    pthread_mutex_lock(&ms->lock);
+
+    for (;;) {
+        while (ms->top == 0 && ms->pending > 0) {
+            pthread_cond_wait(&ms->cond, &ms->lock);
+        }
+        if (ms->top == 0) {
+            break;
+        }
+
+        ms_rect r = ms->stack[--ms->top];
+        pthread_mutex_unlock(&ms->lock);
+
+        ms_rect children[2];
+        int nchildren = ms_process(ms, r, children, stats);
+
+        pthread_mutex_lock(&ms->lock);
+        if (ms->top + nchildren > ms->capacity) {
+            ms->capacity *= 2;
+            ms->stack = realloc(ms->stack, ms->capacity * sizeof(ms_rect));
+            if (ms->stack == NULL) {
+                fprintf(stderr, "Failed to grow the rectangle stack\n");
+                exit(1);
+            }
+        }
+        for (int c = 0; c < nchildren; c++) {
+            ms->stack[ms->top++] = children[c];
+        }
+        ms->pending += nchildren - 1;
+        if (nchildren > 0 || ms->pending == 0) {
+            pthread_cond_broadcast(&ms->cond);
+        }
+    }
+
+    pthread_mutex_unlock(&ms->lock);
+}
+
+struct refine_state {
+    const frame_view *view;
+    int *iters;
+    int validate;
+    int nthreads;
+    refine_pass_fn on_pass;
+    void *ctx;
+    pthread_barrier_t barrier;
+};
+
+refine_state *refine_create(const frame_view *view, int *iters, int nthreads, refine_pass_fn on_pass, void *ctx) {
+    refine_state *rf = malloc(sizeof(refine_state));
+    if (rf == NULL) {
+        return NULL;
+    }
+
+    rf->view = view;
+    rf->iters = iters;
+    rf->validate = kernel_get_options() & KERNEL_OPT_VALIDATE;
+    rf->nthreads = nthreads;
+    rf->on_pass = on_pass;
+    rf->ctx = ctx;
+    pthread_barrier_init(&rf->barrier, NULL, nthreads);
+    return rf;
+}
+
+void refine_free(refine_state *rf) {
+    pthread_barrier_destroy(&rf->barrier);
+    free(rf);
+}
+
+// Returns 1 if the step-sized cell with lower left corner (x, y) lies
+// inside the frame and its four corners have the same count
+static int refine_uniform(const refine_state *rf, int x, int y, int step) {
+    int width = rf->view->width;
+    const int *iters = rf->iters;
+
+    if (x + step >= width || y + step >= rf->view->height) {
+        return 0;
+    }
+    int value = iters[(size_t)y * width + x];
+    return iters[(size_t)y * width + x + step] == value &&
+           iters[(size_t)(y + step) * width + x] == value &&
+           iters[(size_t)(y + step) * width + x + step] == value;
+}
+
+// Fill in row j of the pass that halves step: every pixel on the half-step
+// grid that is not on the step grid yet. With step 0 this is the first pass
+// and computes the REFINE_START_STEP grid outright.
+static void refine_row(refine_state *rf, int j, int step, int *cols, int *found, kernel_stats *stats) {
+    const frame_view *view = rf->view;
+    int width = view->width;
+    int *row = rf->iters + (size_t)j * width;
+    int half = step ? step / 2 : REFINE_START_STEP;
+    int first = step && j % step == 0 ? half : 0;
+    int stride = step && j % step == 0 ? step : half;
+    int n = 0, guessed = 0;
+
+    // Computed columns fill cols from the front, guessed ones from the back
+    for (int i = first; i < width; i += stride) {
+        int x = step ? i - i % step : 0;
+        if (step && refine_uniform(rf, x, j - j % step, step)) {
+            row[i] = rf->iters[(size_t)(j - j % step) * width + x];
+            cols[width - 1 - guessed++] = i;
+        } else {
+            cols[n++] = i;
+        }
+    }
+
+    view_gather(view, j, cols, n, found, stats);
+    for (int k = 0; k < n; k++) {
+        row[cols[k]] = found[k];
+    }
+    stats->filled += guessed;
+
+    if (rf->validate && guessed > 0) {
+        view_gather(view, j, cols + width - guessed, guessed, found, NULL);
+        for (int k = 0; k < guessed; k++) {
+            stats->mismatched += found[k] != row[cols[width - guessed + k]];
+        }
+        stats->validated += guessed;
+    }
+}
+
+void refine_run(refine_state *rf, int thread_id, kernel_stats *stats) {
+    const frame_view *view = rf->view;
+    int *cols = malloc(view->width * sizeof(int));
+    int *found = malloc(view->width * sizeof(int));
+    int pass = 0;
+
+    if (cols == NULL || found == NULL) {
+        fprintf(stderr, "Failed to allocate the refinement buffers\n");
+        exit(1);
+    }
+
+    // step is the grid the previous pass left complete, 0 before the first
+    for (int step = 0; step != 1; step = step ? step / 2 : REFINE_START_STEP) {
+        int half = step ? step / 2 : REFINE_START_STEP;
+
+        // Deal the rows of this pass out round robin so every thread gets
+        // a share of the expensive parts of the frame
+        for (int j = thread_id * half; j < view->height; j += rf->nthreads * half) {
+            refine_row(rf, j, step, cols, found, stats);
+        }
+
+        // Every pass reads the corners the one before it wrote
+        if (pthread_barrier_wait(&rf->barrier) == PTHREAD_BARRIER_SERIAL_THREAD && half > 1 && rf->on_pass) {
+            rf->on_pass(rf->ctx, pass, half, rf->iters);
+        }
+        pthread_barrier_wait(&rf->barrier);
+        pass++;
+    }
+
+    free(cols);
+    free(found);
+}
@@ -0,0 +1,103 @@
+///
+//  render.h
+//  Frame setup shared by the renderers, the Mariani-Silver rectangle
+//  subdivision renderer and the successive refinement renderer.
+///
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "kernel.h"
+#include "bigfloat.h"
+#include "perturb.h"
+
+// Below this scale double coordinates pixelate and frames switch to double-double
+#define DD_SCALE 1e-13
+
+// Below this scale double-double runs out too and frames switch to perturbation
+#define PERTURB_SCALE 1e-28
+
+typedef enum {
+    ENGINE_AUTO,
+    ENGINE_DOUBLE,
+    ENGINE_DD,
+    ENGINE_PERTURB
+} engine_type;
+
+typedef enum {
+    RENDER_BANDS,
+    RENDER_MARIANI_SILVER,
+    RENDER_REFINE
+} renderer_type;
+
+// Everything needed to evaluate any pixel of one frame. It is read-only
+// once set up, so all threads of a frame share one.
+typedef struct {
+    int width, height;
+    kernel_params params;
+    engine_type engine;          // engine picked for this frame, never ENGINE_AUTO
+    double scale;
+    double xmin, xmax, ymin, ymax;
+    double y;                    // center imaginary part, rounded to double
+    dd_real ycenter;             // double-double center for ENGINE_DD
+    double *xs;                  // per column: real part, its high part (dd) or offset (perturbation)
+    double *xs_lo;               // per column: low part of the real part (dd)
+    reference_orbit *ref;        // reference orbit for ENGINE_PERTURB
+} frame_view;
+
+// Set up a view of the frame centered at (x, y) (exactly (cx, cy)) with the
+// given scale. Picks the engine for ENGINE_AUTO and computes the reference
+// orbit for perturbation, without printing anything, so probes can use it
+// too. Returns 0 on success, -1 if out of memory.
+int frame_view_init(frame_view *view, double x, double y, const bigfloat *cx, const bigfloat *cy,
+                    engine_type engine, int use_series, double scale, int width, int height, int max);
+
+void frame_view_free(frame_view *view);
+
+// Calculate the iterations for count pixels of row j, starting at column i.
+// Row 0 is the bottom of the image.
+void view_span(const frame_view *view, int j, int i, int count, int *iters, kernel_stats *stats);
+
+// Row whose imaginary part is exactly the negative of row j's, so its
+// counts are the same by the symmetry of the set about the real axis, or
+// -1 if there is none. Perturbation frames never have one.
+int view_mirror_row(const frame_view *view, int j);
+
+// Calculate the iterations for count pixels of column i, starting at row j
+void view_column(const frame_view *view, int i, int j, int count, int *iters, kernel_stats *stats);
+
+// Mariani-Silver: evaluate the border of a rectangle, fill it when the
+// whole border (and the two rings inside it) is inside the set, otherwise
+// split it in two and recurse.
+// Rectangles are shared between all the threads that call ms_run.
+typedef struct ms_state ms_state;
+
+// iters must hold width*height counts; every entry is written
+ms_state *ms_create(const frame_view *view, int *iters);
+
+// Work on the frame until every rectangle is done - call from each thread
+void ms_run(ms_state *ms, kernel_stats *stats);
+
+void ms_free(ms_state *ms);
+
+// Successive refinement: compute every 8th pixel of every 8th row, then
+// halve the grid spacing until it is 1. A new grid point inside a cell
+// whose four corners have the same count takes that count without being
+// computed. Quick to preview, but unlike ms it can guess wrong where a
+// detail fits between the corners of a cell.
+typedef struct refine_state refine_state;
+
+// Called by one thread after each pass but the last, while the others
+// wait. The grid with the given spacing is complete: pixel (i, j) can be
+// previewed with the count of (i - i % step, j - j % step).
+typedef void (*refine_pass_fn)(void *ctx, int pass, int step, const int *iters);
+
+// iters must hold width*height counts, and exactly nthreads threads must
+// call refine_run. on_pass may be NULL.
+refine_state *refine_create(const frame_view *view, int *iters, int nthreads, refine_pass_fn on_pass, void *ctx);
+
+// Work on the passes assigned to thread_id (0 to nthreads - 1) until the frame is done
+void refine_run(refine_state *rf, int thread_id, kernel_stats *stats);
+
+void refine_free(refine_state *rf);
+
+#endif  /* Compile guard */
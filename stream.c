@@ -0,0 +1,196 @@
+///
+//  stream.c
+//  Frames written as one YUV4MPEG2 or raw RGB video stream in frame
+//  order, for piping straight into an encoder such as ffmpeg.
+///
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "stream.h"
+
+// Frames per second in the Y4M header, ffmpeg's default for image sequences
+#define STREAM_FPS 25
+
+struct frame_stream {
+    int fd;
+    int pipe;                // forward over a pipe instead of writing video
+    stream_format format;
+    int width, height;
+    int nframes;
+    int next;                // next frame to write
+    int failed;
+    imgRawImage **pending;   // frames that finished before frame next
+    unsigned char *planes;   // Y4M conversion buffer
+    image_pool *images;
+    pthread_mutex_t lock;
+};
+
+static int write_all(int fd, const void *buf, size_t len) {
+    const unsigned char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Returns 1 when len bytes were read, 0 at end of file before any, -1 otherwise
+static int read_all(int fd, void *buf, size_t len) {
+    unsigned char *p = buf;
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = read(fd, p + got, len - got);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return n == 0 && got == 0 ? 0 : -1;
+        }
+        got += n;
+    }
+    return 1;
+}
+
+static frame_stream *stream_alloc(int fd, int width, int height, image_pool *images) {
+    frame_stream *s = calloc(1, sizeof(frame_stream));
+    if (s == NULL) {
+        return NULL;
+    }
+    s->fd = fd;
+    s->width = width;
+    s->height = height;
+    s->images = images;
+    pthread_mutex_init(&s->lock, NULL);
+    return s;
+}
+
+frame_stream *stream_create(int fd, stream_format format, int width, int height, int nframes, image_pool *images) {
+    frame_stream *s = stream_alloc(fd, width, height, images);
+    if (s == NULL) {
+        return NULL;
+    }
+    s->format = format;
+    s->nframes = nframes;
+    s->pending = calloc(nframes, sizeof(imgRawImage *));
+    if (format == STREAM_Y4M) {
+        s->planes = malloc((size_t)width * height * 3);
+    }
+    if (s->pending == NULL || (format == STREAM_Y4M && s->planes == NULL)) {
+        free(s->pending);
+        free(s->planes);
+        free(s);
+        return NULL;
+    }
+
+    if (format == STREAM_Y4M) {
+        char header[128];
+        int len = snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", width, height, STREAM_FPS);
+        s->failed = write_all(fd, header, len) != 0;
+    }
+    return s;
+}
+
+frame_stream *stream_create_pipe(int fd, int width, int height, image_pool *images) {
+    frame_stream *s = stream_alloc(fd, width, height, images);
+    if (s) {
+        s->pipe = 1;
+    }
+    return s;
+}
+
+// Write one frame of video. Y4M frames are converted to full-resolution
+// BT.601 studio-range Y, Cb and Cr planes.
+static int stream_write_frame(frame_stream *s, const imgRawImage *img) {
+    size_t pixels = (size_t)s->width * s->height;
+
+    if (s->format == STREAM_RGB) {
+        return write_all(s->fd, img->lpData, pixels * 3);
+    }
+
+    unsigned char *y = s->planes, *cb = y + pixels, *cr = cb + pixels;
+    for (size_t k = 0; k < pixels; k++) {
+        int r = img->lpData[3 * k], g = img->lpData[3 * k + 1], b = img->lpData[3 * k + 2];
+        y[k] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+        cb[k] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+        cr[k] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+    }
+    if (write_all(s->fd, "FRAME\n", 6) != 0) {
+        return -1;
+    }
+    return write_all(s->fd, s->planes, pixels * 3);
+}
+
+void stream_put(frame_stream *s, int frame, imgRawImage *img) {
+    pthread_mutex_lock(&s->lock);
+
+    if (s->pipe) {
+        int32_t number = frame;
+        if (write_all(s->fd, &number, sizeof(number)) != 0 ||
+            write_all(s->fd, img->lpData, (size_t)s->width * s->height * 3) != 0) {
+            s->failed = 1;
+        }
+        image_pool_put(s->images, img);
+    } else if (frame < s->next || frame >= s->nframes || s->pending[frame]) {
+        fprintf(stderr, "Frame %d was streamed twice\n", frame + 1);
+        image_pool_put(s->images, img);
+    } else {
+        s->pending[frame] = img;
+        while (s->next < s->nframes && s->pending[s->next]) {
+            if (!s->failed && stream_write_frame(s, s->pending[s->next]) != 0) {
+                s->failed = 1;
+                perror("Failed to write the video stream");
+            }
+            image_pool_put(s->images, s->pending[s->next]);
+            s->pending[s->next++] = NULL;
+        }
+    }
+
+    pthread_mutex_unlock(&s->lock);
+}
+
+int stream_receive(frame_stream *s, int fd) {
+    int32_t number;
+    int got = read_all(fd, &number, sizeof(number));
+    if (got <= 0) {
+        return got;
+    }
+
+    imgRawImage *img = image_pool_get(s->images, s->width, s->height);
+    if (read_all(fd, img->lpData, (size_t)s->width * s->height * 3) != 1) {
+        image_pool_put(s->images, img);
+        return -1;
+    }
+    stream_put(s, number, img);
+    return 1;
+}
+
+int stream_close(frame_stream *s) {
+    int result = s->failed ? -1 : 0;
+
+    if (!s->pipe && s->next < s->nframes) {
+        fprintf(stderr, "Video stream stopped at frame %d of %d\n", s->next + 1, s->nframes);
+        result = -1;
+        for (int k = s->next; k < s->nframes; k++) {
+            if (s->pending[k]) {
+                image_pool_put(s->images, s->pending[k]);
+            }
+        }
+    }
+
+    pthread_mutex_destroy(&s->lock);
+    free(s->pending);
+    free(s->planes);
+    free(s);
+    return result;
+}
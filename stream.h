@@ -0,0 +1,41 @@
+///
+//  stream.h
+//  Frames written as one YUV4MPEG2 or raw RGB video stream in frame
+//  order, for piping straight into an encoder such as ffmpeg.
+///
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "jpegrw.h"
+#include "imgpool.h"
+
+typedef enum {
+    STREAM_Y4M,
+    STREAM_RGB
+} stream_format;
+
+typedef struct frame_stream frame_stream;
+
+// Write frames 0 to nframes - 1 to fd in order, holding back frames that
+// finish early until the ones before them are written. Writes the stream
+// header straight away. Written frames go back to images (which may be
+// NULL). Returns NULL if out of memory.
+frame_stream *stream_create(int fd, stream_format format, int width, int height, int nframes, image_pool *images);
+
+// Send frames to another process over the pipe fd as they finish; that
+// process hands them to stream_receive
+frame_stream *stream_create_pipe(int fd, int width, int height, image_pool *images);
+
+// Hand over frame number frame (from 0); the stream gives img back once
+// it is written. Safe to call from several threads.
+void stream_put(frame_stream *s, int frame, imgRawImage *img);
+
+// Read one frame sent by a stream_create_pipe stream from fd and put it
+// in s. Returns 1 for a frame, 0 when the pipe is closed, -1 on errors.
+int stream_receive(frame_stream *s, int fd);
+
+// Returns 0 if every frame was written, -1 if frames are missing or a write failed.
+// Does not close the file descriptor.
+int stream_close(frame_stream *s);
+
+#endif  /* Compile guard */
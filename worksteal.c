@@ -0,0 +1,255 @@
+///
+//  worksteal.c
+//  Work-stealing scheduler: every worker owns a Chase-Lev deque of
+//  tasks, runs its own newest task first and steals the oldest task of
+//  another worker when it runs dry. Tasks may spawn more tasks.
+//
+//  The deque follows Le, Pop, Cohen and Zappa Nardelli, "Correct and
+//  Efficient Work-Stealing for Weak Memory Models" (PPoPP 2013).
+///
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include "worksteal.h"
+
+#define DEQUE_INITIAL_SIZE 256
+
+typedef struct deque_array {
+    long size;                   // a power of two
+    struct deque_array *older;   // replaced arrays, freed with the deque
+    _Atomic(ws_task *) buf[];
+} deque_array;
+
+// Only the owner pushes and takes at the bottom; thieves take at the top
+typedef struct {
+    atomic_long top;
+    atomic_long bottom;
+    _Atomic(deque_array *) array;
+    double busy;
+    char pad[64];                // keep neighbouring deques off this cache line
+} deque;
+
+struct worksteal {
+    int nworkers;
+    deque *deques;
+    atomic_long pending;         // tasks queued or running
+
+    // Workers that find nothing to steal sleep here until a task is
+    // spawned or the last one finishes
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    atomic_int idle;             // workers asleep or about to be
+    atomic_long spawned;         // bumped by every spawn
+};
+
+typedef struct {
+    worksteal *s;
+    int worker;
+} worker_arg;
+
+static deque_array *deque_array_new(long size) {
+    deque_array *a = malloc(sizeof(deque_array) + size * sizeof(a->buf[0]));
+    if (a == NULL) {
+        fprintf(stderr, "Failed to grow a task deque\n");
+        exit(1);
+    }
+    a->size = size;
+    a->older = NULL;
+    return a;
+}
+
+static void deque_push(deque *q, ws_task *task) {
+    long b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&q->top, memory_order_acquire);
+    deque_array *a = atomic_load_explicit(&q->array, memory_order_relaxed);
+
+    if (b - t > a->size - 1) {
+        // Thieves may still read the old array, so it is kept until the end
+        deque_array *grown = deque_array_new(2 * a->size);
+        for (long k = t; k < b; k++) {
+            atomic_store_explicit(&grown->buf[k & (grown->size - 1)],
+                                  atomic_load_explicit(&a->buf[k & (a->size - 1)], memory_order_relaxed),
+                                  memory_order_relaxed);
+        }
+        grown->older = a;
+        atomic_store_explicit(&q->array, grown, memory_order_release);
+        a = grown;
+    }
+    atomic_store_explicit(&a->buf[b & (a->size - 1)], task, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+}
+
+static ws_task *deque_take(deque *q) {
+    long b = atomic_load_explicit(&q->bottom, memory_order_relaxed) - 1;
+    deque_array *a = atomic_load_explicit(&q->array, memory_order_relaxed);
+    atomic_store_explicit(&q->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&q->top, memory_order_relaxed);
+    ws_task *task = NULL;
+
+    if (t <= b) {
+        task = atomic_load_explicit(&a->buf[b & (a->size - 1)], memory_order_relaxed);
+        if (t == b) {
+            // Last task: race the thieves for it
+            if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+                task = NULL;
+            }
+            atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+        }
+    } else {
+        atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+static ws_task *deque_steal(deque *q) {
+    long t = atomic_load_explicit(&q->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&q->bottom, memory_order_acquire);
+
+    if (t < b) {
+        deque_array *a = atomic_load_explicit(&q->array, memory_order_acquire);
+        ws_task *task = atomic_load_explicit(&a->buf[t & (a->size - 1)], memory_order_relaxed);
+        if (atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+            return task;
+        }
+    }
+    return NULL;
+}
+
+static double seconds_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void *ws_worker(void *arg) {
+    worksteal *s = ((worker_arg *)arg)->s;
+    int worker = ((worker_arg *)arg)->worker;
+    deque *own = &s->deques[worker];
+    unsigned int seed = worker + 1;
+
+    while (atomic_load(&s->pending) > 0) {
+        long spawned = atomic_load(&s->spawned);
+        ws_task *task = deque_take(own);
+
+        // Out of work: try every other worker once, starting at a random one
+        int first = rand_r(&seed) % s->nworkers;
+        for (int k = 0; task == NULL && k < s->nworkers; k++) {
+            int victim = (first + k) % s->nworkers;
+            if (victim != worker) {
+                task = deque_steal(&s->deques[victim]);
+            }
+        }
+        if (task == NULL) {
+            // Sleep unless a task was spawned since the deques were looked
+            // at. ws_spawn checks idle after bumping spawned, so one of the
+            // two always sees the other.
+            pthread_mutex_lock(&s->lock);
+            atomic_fetch_add(&s->idle, 1);
+            if (atomic_load(&s->spawned) == spawned && atomic_load(&s->pending) > 0) {
+                pthread_cond_wait(&s->wake, &s->lock);
+            }
+            atomic_fetch_sub(&s->idle, 1);
+            pthread_mutex_unlock(&s->lock);
+            continue;
+        }
+
+        double start = seconds_now();
+        task->fn(s, worker, task->arg);
+        own->busy += seconds_now() - start;
+        if (atomic_fetch_sub(&s->pending, 1) == 1) {
+            pthread_mutex_lock(&s->lock);
+            pthread_cond_broadcast(&s->wake);
+            pthread_mutex_unlock(&s->lock);
+        }
+    }
+    return NULL;
+}
+
+worksteal *ws_create(int nworkers) {
+    worksteal *s = malloc(sizeof(worksteal));
+    if (s == NULL) {
+        return NULL;
+    }
+    s->nworkers = nworkers;
+    s->deques = calloc(nworkers, sizeof(deque));
+    if (s->deques == NULL) {
+        free(s);
+        return NULL;
+    }
+    atomic_init(&s->pending, 0);
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->wake, NULL);
+    atomic_init(&s->idle, 0);
+    atomic_init(&s->spawned, 0);
+    for (int w = 0; w < nworkers; w++) {
+        atomic_init(&s->deques[w].top, 0);
+        atomic_init(&s->deques[w].bottom, 0);
+        atomic_init(&s->deques[w].array, deque_array_new(DEQUE_INITIAL_SIZE));
+    }
+    return s;
+}
+
+int ws_workers(const worksteal *s) {
+    return s->nworkers;
+}
+
+void ws_submit(worksteal *s, int worker, ws_task *task) {
+    ws_spawn(s, worker, task);
+}
+
+void ws_spawn(worksteal *s, int worker, ws_task *task) {
+    // Counted before it is visible, so pending cannot reach 0 while it waits
+    atomic_fetch_add(&s->pending, 1);
+    deque_push(&s->deques[worker], task);
+
+    atomic_fetch_add(&s->spawned, 1);
+    if (atomic_load(&s->idle) > 0) {
+        pthread_mutex_lock(&s->lock);
+        pthread_cond_signal(&s->wake);
+        pthread_mutex_unlock(&s->lock);
+    }
+}
+
+int ws_run(worksteal *s) {
+    pthread_t threads[s->nworkers];
+    worker_arg args[s->nworkers];
+
+    for (int w = 0; w < s->nworkers; w++) {
+        args[w] = (worker_arg){ s, w };
+        if (pthread_create(&threads[w], NULL, ws_worker, &args[w]) != 0) {
+            // Workers already started finish all the tasks between them
+            for (int k = 0; k < w; k++) {
+                pthread_join(threads[k], NULL);
+            }
+            return w > 0 ? 0 : -1;
+        }
+    }
+    for (int w = 0; w < s->nworkers; w++) {
+        pthread_join(threads[w], NULL);
+    }
+    return 0;
+}
+
+double ws_busy(const worksteal *s, int worker) {
+    return s->deques[worker].busy;
+}
+
+void ws_free(worksteal *s) {
+    for (int w = 0; w < s->nworkers; w++) {
+        deque_array *a = atomic_load(&s->deques[w].array);
+        while (a) {
+            deque_array *older = a->older;
+            free(a);
+            a = older;
+        }
+    }
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->wake);
+    free(s->deques);
+    free(s);
+}
@@ -0,0 +1,41 @@
+///
+//  worksteal.h
+//  Work-stealing scheduler: every worker owns a Chase-Lev deque of
+//  tasks, runs its own newest task first and steals the oldest task of
+//  another worker when it runs dry. Tasks may spawn more tasks.
+///
+#ifndef WORKSTEAL_H
+#define WORKSTEAL_H
+
+typedef struct worksteal worksteal;
+
+typedef void (*ws_fn)(worksteal *s, int worker, void *arg);
+
+// A unit of work. The scheduler only keeps a pointer, so a task must stay
+// valid until it has run.
+typedef struct {
+    ws_fn fn;
+    void *arg;
+} ws_task;
+
+// Returns NULL if out of memory
+worksteal *ws_create(int nworkers);
+
+int ws_workers(const worksteal *s);
+
+// Queue a task on a worker before ws_run starts
+void ws_submit(worksteal *s, int worker, ws_task *task);
+
+// Queue a task from inside a running task; worker is the one running it
+void ws_spawn(worksteal *s, int worker, ws_task *task);
+
+// Run the workers until every task, including the ones spawned along the
+// way, has finished
+int ws_run(worksteal *s);
+
+// Seconds worker spent inside tasks during ws_run
+double ws_busy(const worksteal *s, int worker);
+
+void ws_free(worksteal *s);
+
+#endif  /* Compile guard */